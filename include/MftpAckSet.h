@@ -0,0 +1,87 @@
+/**
+ * MftpAckSet.h implements the set of remote hosts that have not acknowledged the packet in flight, as a bitset with a
+ * population count: membership tests and updates, and the "all acknowledged" test, are O(1), and the hosts still in
+ * the set are found by scanning 64 of them per word.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPACKSET_H_
+#define INCLUDE_MFTPACKSET_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MftpAckSet {
+public:
+   MftpAckSet() : hosts(0), pending(0) {}
+
+   /**
+    * Resize the set for a number of hosts, and empty it.
+    * @param count the number of hosts
+    */
+   void resize(size_t count) {
+      hosts = count;
+      pending = 0;
+      words.assign((count + WORD_BITS - 1) / WORD_BITS, 0);
+   }
+
+   /**
+    * Add every host to the set (a new packet is in flight).
+    */
+   void insert_all() {
+      if (words.empty())
+         return;
+      std::fill(words.begin(), words.end(), ~(uint64_t) 0);
+      if (hosts % WORD_BITS)
+         words.back() = ((uint64_t) 1 << (hosts % WORD_BITS)) - 1;
+      pending = hosts;
+   }
+
+   /**
+    * Remove a host from the set (it has acknowledged).
+    * @param host the host index
+    * @return true if the host was in the set
+    */
+   bool erase(size_t host) {
+      uint64_t bit = (uint64_t) 1 << (host % WORD_BITS);
+      uint64_t &word = words[host / WORD_BITS];
+      if (!(word & bit))
+         return false;
+      word &= ~bit;
+      --pending;
+      return true;
+   }
+
+   bool contains(size_t host) const { return words[host / WORD_BITS] & ((uint64_t) 1 << (host % WORD_BITS)); }
+   size_t count() const { return pending; }
+   bool empty() const { return pending == 0; }
+
+   /**
+    * Call a function for every host in the set, in index order. The function may erase the host it is given.
+    * @param f called with each host index
+    */
+   template<typename F>
+   void for_each(F f) const {
+      for (size_t w = 0; w < words.size(); ++w) {
+         uint64_t bits = words[w];
+         while (bits) {
+            f(w * WORD_BITS + __builtin_ctzll(bits));
+            bits &= bits - 1;
+         }
+      }
+   }
+
+private:
+   static const size_t WORD_BITS = 64;
+
+   std::vector<uint64_t> words;
+   size_t hosts, pending;
+};
+
+#endif /* INCLUDE_MFTPACKSET_H_ */
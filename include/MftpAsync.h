@@ -0,0 +1,124 @@
+/**
+ * MftpAsync.h implements the embeddable, non-blocking transfer API. An MftpAsyncSender drives an MftpClient, and an
+ * MftpAsyncReceiver an MftpServer, from an event loop (an MftpReactor, or an MftpSimNet in simulations) instead of
+ * blocking in rdt_send()/rdt_receive(), so that one thread can run any number of transfers at once. Progress and
+ * completion are reported through callbacks.
+ *
+ *    MftpReactor reactor;
+ *    MftpAsyncSender sender(reactor, client);
+ *    sender.on_complete([](bool success) { ... });
+ *    sender.start(input);
+ *    reactor.run();
+ *
+ * The client or server is configured before start(), and must outlive the transfer. An MftpAsyncHandshake runs the v2
+ * handshake of a client on the loop first, where the transfer needs one.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPASYNC_H_
+#define INCLUDE_MFTPASYNC_H_
+
+#include <functional>
+#include <istream>
+#include <vector>
+
+#include "MftpReactor.h"
+#include "MftpClient.h"
+#include "MftpServer.h"
+
+typedef std::function<void(uint64_t bytes)> MftpProgressCallback;   // Bytes acknowledged (sender) or received
+typedef std::function<void(bool success)> MftpCompletionCallback;
+
+/**
+ * Runs the v2 handshake of an MftpClient (see MftpClient::handshake()) from an event loop: capabilities, path MTU, and
+ * the relay tree and repair peers setup. The completion reports the handshake's result.
+ */
+class MftpAsyncHandshake {
+public:
+   MftpAsyncHandshake(MftpEventLoop &reactor, MftpClient &client);
+   ~MftpAsyncHandshake();
+   void on_complete(MftpCompletionCallback callback) { completion = callback; }
+   bool start(uint32_t bandwidth_mbps);
+   bool done() const { return finished; }
+
+private:
+   MftpEventLoop &reactor;
+   MftpClient &client;
+   MftpCompletionCallback completion;
+   bool started, finished;
+   MftpEventLoop::TimerId timer;
+
+   void poll();
+};
+
+/**
+ * Sends a byte stream to the servers of an MftpClient. Data is pulled from the source as packets are acknowledged,
+ * so the source should return promptly (it runs on the event loop). A source that has no data yet returns -1, and
+ * resume() is called once it has.
+ */
+class MftpAsyncSender {
+public:
+   typedef std::function<ssize_t(char *buffer, size_t len)> Source; // Fills the buffer; returns 0 at the end
+
+   MftpAsyncSender(MftpEventLoop &reactor, MftpClient &client);
+   ~MftpAsyncSender();
+   void on_progress(MftpProgressCallback callback) { progress = callback; }
+   void on_complete(MftpCompletionCallback callback) { completion = callback; }
+   bool start(Source source);
+   bool start(std::istream &in);
+   void resume();
+   bool done() const { return finished; }
+
+private:
+   static const size_t SOURCE_BLOCK = 65536;
+
+   MftpEventLoop &reactor;
+   MftpClient &client;
+   Source source;
+   MftpProgressCallback progress;
+   MftpCompletionCallback completion;
+   std::vector<char> block;
+   size_t block_pos, block_len;
+   bool started, end_of_input, in_flight, finished;
+   bool waiting; // The source had no data yet
+   MftpEventLoop::TimerId timer;
+
+   void pump();
+   void acknowledged();
+   void on_readable();
+   void on_timer();
+   void finish();
+};
+
+/**
+ * Receives a transfer into the file (or stream) of an MftpServer.
+ */
+class MftpAsyncReceiver {
+public:
+   MftpAsyncReceiver(MftpEventLoop &reactor, MftpServer &server);
+   ~MftpAsyncReceiver();
+   void on_progress(MftpProgressCallback callback) { progress = callback; }
+   void on_complete(MftpCompletionCallback callback) { completion = callback; }
+   bool start();
+   bool done() const { return finished; }
+
+private:
+   MftpEventLoop &reactor;
+   MftpServer &server;
+   MftpProgressCallback progress;
+   MftpCompletionCallback completion;
+   bool started, finished;
+   bool draining; // The transfer has ended, the server's relay is still forwarding
+   MftpEventLoop::TimerId timer; // Runs the server's timers (held-back packets, peer repair)
+
+   void on_readable();
+   void on_timer();
+   void handled(bool more, uint64_t received);
+   void end();
+};
+
+#endif /* INCLUDE_MFTPASYNC_H_ */
@@ -0,0 +1,44 @@
+/**
+ * MftpChunkQueue.h implements the bounded hand-off between a receiving thread and a draining thread (relay forwarding,
+ * streaming to stdout), or a consumer on an event loop that reads without waiting. The producer never blocks: when the
+ * queue holds its capacity in bytes, offer() fails and the caller withholds its ACK, so that backpressure travels to
+ * the sender through the protocol instead of growing memory.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPCHUNKQUEUE_H_
+#define INCLUDE_MFTPCHUNKQUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+class MftpChunkQueue {
+public:
+   explicit MftpChunkQueue(size_t capacity_bytes);
+
+   bool accepts(size_t len);
+   bool offer(const char *data, size_t len);
+   bool take_all(std::vector<std::string> &chunks);
+   ssize_t read(char *buffer, size_t len);
+   void close();
+
+private:
+   std::deque<std::string> queue;
+   size_t queued_bytes, capacity;
+   bool closed;
+   std::mutex queue_mutex;
+   std::condition_variable queue_ready;
+
+   bool has_room(size_t len) const { return queued_bytes + len <= capacity || queue.empty(); }
+};
+
+#endif /* INCLUDE_MFTPCHUNKQUEUE_H_ */
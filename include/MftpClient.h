@@ -3,7 +3,9 @@
  * (Reliable Data Transfer Send) API which takes a byte stream from a caller, and handles creation, checksumming, and
  * transmission of packets. MftpClient also handles incoming SAW acks, timeouts, and retransmissions as appropriate.
  * This class also handles timepoint measurement for experimental data gathering related to efficiency experiments
- * on the SAW rdt_send/rdt_receive protocol.
+ * on the SAW rdt_send/rdt_receive protocol. With a relay fan-out, the client only sends to the first tier of servers,
+ * which forward the stream down a k-ary tree of the remaining servers. In carousel mode, the client instead sends a
+ * paced, feedback-free stream of fountain-coded symbols and keeps no per-server state.
  *
  * Created on: June 23th, 2021
  * Author: Stevan Dupor
@@ -15,35 +17,159 @@
 #define INCLUDE_MFTPCLIENT_H_
 
 #include "UDP_Communicator.h"
+#include "MftpStats.h"
 
 class MftpClient : public UDP_Communicator {
 
 private:
    //Communication Variables
-   std::vector<RemoteHost> remote_hosts;
+   RemoteHosts remote_hosts;
+   std::vector<int> shared_sockets; // The sockets every server is reached through (multipath: one per local address)
    uint16_t MSS, byte_index;
+   uint16_t packet_len; // Payload length of the packet in flight (the last packet of the stream may be short)
+   uint64_t byte_offset; // Offset in the stream of the packet currently in the output buffer
    int system_port;
 
-   // Timing variables
-   std::chrono::time_point<std::chrono::steady_clock> timeout_start;
-   uint_fast64_t timeout_us;
+   // Shared sockets: servers per socket (the ACKs of one packet arrive together and must fit in its receive buffer),
+   // kernel receive buffer bytes taken by one ACK, and the largest number of sockets. Names are resolved in parallel.
+   static const size_t HOSTS_PER_SOCKET = 256;
+   static const int ACK_BUFFER_BYTES = 1024;
+   static const size_t MAX_SHARED_SOCKETS = 16;
+   static const size_t MAX_RESOLVER_THREADS = 32;
+
+   // Handshake parameters
+   static const int HANDSHAKE_ATTEMPTS = 5;
+   static const uint_fast64_t HANDSHAKE_WAIT_US = 200000;
+   static const int MIN_SOCKET_BUFFER = 65536;
+   static const int MAX_SOCKET_BUFFER = 16777216;
+   uint16_t features; // Optional features requested from the servers
+
+   // Handshake in progress (see begin_handshake()): its step and result, and the exchange of the step -- the packet in
+   // the output buffer is sent to the servers that have not replied, `attempts` more times, each time waiting until
+   // `expiry` for their replies
+   enum HandshakeStep { SYN_STEP, PROBE_STEP, CONFIRM_STEP, RELAY_STEP, PEER_STEP, HANDSHAKE_DONE };
+   struct HandshakeExchange {
+      int reply_type;
+      uint64_t offset;
+      size_t len;
+      std::vector<bool> replied;
+      size_t pending;
+      int attempts;
+      uint_fast64_t wait_us;
+      MftpTransport::TimePoint sent, expiry;
+   };
+   HandshakeStep handshake_step;
+   bool handshake_ok;
+   uint32_t handshake_bandwidth_mbps;
+   HandshakeExchange exchange;
+
+   // Path MTU probing: the sizes left to probe (largest last) and each server's bound from the transport's estimate
+   std::vector<size_t> probe_sizes, probe_bounds;
+
+   // Relay tree: every server in breadth-first order (remote_hosts keeps only the first tier) and the fan-out
+   std::vector<sockaddr_in> relay_tree;
+   uint16_t fanout;
+   static const size_t HOSTS_PER_SETUP = // Hosts in one RELAY_SETUP or PEER_SETUP packet; longer lists are split
+           (MSG_LEN - WireHeaderV2View::SIZE - WireRelaySetupView::SIZE) / WireRelaySetupView::HOST_SIZE;
+
+   // Peer-assisted repair: number of neighbours each server may ask for a lost packet
+   static const size_t REPAIR_PEERS = 4;
+   uint_fast64_t peer_repairs;
+
+   // Relay and peer setup: the server being sent its host list, the list, and the start of the part being sent
+   size_t setup_host, setup_first;
+   std::vector<sockaddr_in> setup_list;
+
+   // Carousel: largest source block in symbols, blocks encoded together (interleaved), and FINs sent to each server
+   static const uint32_t CAROUSEL_BLOCK_SYMBOLS = 1024;
+   static const size_t CAROUSEL_WINDOW_BLOCKS = 16;
+   static const int CAROUSEL_FIN_REPEATS = 3;
+
+   // Timing variables. While a receiver reports backpressure, retransmissions are probes spaced by persist_us.
+   std::chrono::time_point<std::chrono::steady_clock> timeout_start, packet_start, packetize_start;
+
+   // Startup: from the construction of the client to the resolution of every name and to the first data packet
+   std::chrono::time_point<std::chrono::steady_clock> startup_start;
+   uint_fast64_t resolve_us, first_packet_us;
+   uint_fast64_t timeout_us, persist_us;
+   static const uint_fast64_t MIN_PERSIST_US = 1000;
+   static const uint_fast64_t MAX_PERSIST_US = 64000;
    long double EstRTT, DevRTT;
 
    // Utility variables
    std::vector<LogItem> local_time_logs;
    uint_fast32_t loss_count;
-   uint_fast64_t packet_count;
+   uint_fast64_t packet_count, receiver_stalls;
+   MftpStats stats;
 
+   void initialize(std::string &logfile, int port, bool verbose, uint16_t max_seg_size);
+   void add_remote_host(const sockaddr_in &address, const std::string &name);
+   static bool resolve_host(const std::string &spec, int default_port, sockaddr_in &address);
+   static std::vector<bool> resolve_hosts(const std::vector<std::string> &specs, int default_port,
+                                          std::vector<sockaddr_in> &addresses);
+   void open_shared_sockets();
+   void close_shared_sockets();
+   int ack_buffer_bytes() const;
+   void mark_first_packet();
+   static std::vector<size_t> relay_subtree(size_t node, size_t count, uint16_t fanout);
+   void advance_handshake();
+   void end_handshake(bool negotiated);
+   void start_exchange(int reply_type, uint64_t offset, size_t len, int attempts, uint_fast64_t wait_us);
+   void send_exchange();
+   bool exchange_done();
+   void receive_replies(int flags);
+   void begin_probes();
+   void next_probe();
+   void end_probes();
+   void next_relay();
+   void next_peer();
+   void send_host_list_part();
+   static double path_cost(const std::vector<RemotePath> &paths, size_t path);
+   static size_t schedule_path(std::vector<RemotePath> &paths);
+   static size_t best_path(const std::vector<RemotePath> &paths);
+   int data_socket(size_t host) const;
    void system_report();
    void write_time_log();
    bool all_acked();
-   void estimate_timeout();
+   bool valid_ack(int received_len);
+   void receive_acks(int flags);
+   void process_ack(size_t host, size_t path, int received_len);
+   void retransmit_expired();
+   void complete_packet();
+   bool backpressure_ack(int received_len);
+   void estimate_timeout(long double SampRTT);
 
 public:
    MftpClient(std::list<std::string> &server_list, std::string &logfile, int port, bool verbose,
               uint16_t max_seg_size);
-   ~MftpClient() override;
+   MftpClient(const std::vector<sockaddr_in> &server_addresses, std::string &logfile, int port, bool verbose,
+              uint16_t max_seg_size, MftpTransport &transport = MftpSocketTransport::instance());
+   void enable_stats(const std::string &path, uint32_t interval_ms);
+   bool enable_trace(const std::string &path, uint64_t records = MftpTrace::DEFAULT_RECORDS);
+   void set_wire_version(int version);
+   void set_fanout(uint16_t fanout);
+   void enable_peer_repair();
+   bool enable_multipath(const std::string &local_addresses);
+   bool handshake(uint32_t bandwidth_mbps);
+   bool relays() const { return !relay_tree.empty(); }
+
+   // Non-blocking steps of handshake(), for callers that wait for the sockets themselves (MftpAsyncHandshake)
+   void begin_handshake(uint32_t bandwidth_mbps);
+   bool poll_handshake(int flags);
+   uint_fast64_t handshake_in_us() const;
+   bool handshake_result() const { return handshake_ok; }
    void rdt_send(char data);
+   void rdt_send_block(const char *data, size_t len);
+
+   // Non-blocking steps of rdt_send()/shutdown(), for callers that wait for the sockets themselves (MftpAsyncSender)
+   size_t fill(const char *data, size_t len);
+   bool begin_packet(bool last);
+   bool poll_acks();
+   uint_fast64_t retransmit_in_us() const;
+   void finish(int fin_copies = 1);
+   std::vector<int> sockets() const;
+   uint64_t bytes_sent() const { return byte_offset; }
+   bool send_carousel(std::istream &in, uint64_t file_size, double overhead, uint32_t rate_mbps, uint32_t rounds = 1);
    void SaW_process_acks_retransmissions();
    void shutdown();
 
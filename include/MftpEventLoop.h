@@ -0,0 +1,36 @@
+/**
+ * MftpEventLoop.h defines the event loop interface that asynchronous transfers (MftpAsync.h) are driven by: sockets
+ * that call back when readable, and one-shot microsecond timers. MftpReactor implements it over epoll for the real
+ * network; MftpSimNet implements it in virtual time for the simulated network.
+ *
+ * Callbacks run on the thread that runs the loop; they may watch and unwatch sockets and schedule and cancel timers,
+ * and must not block.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPEVENTLOOP_H_
+#define INCLUDE_MFTPEVENTLOOP_H_
+
+#include <cstdint>
+#include <functional>
+
+class MftpEventLoop {
+public:
+   typedef std::function<void()> Callback;
+   typedef uint64_t TimerId;
+
+   virtual ~MftpEventLoop() {}
+
+   virtual bool watch(int fd, Callback on_readable) = 0;
+   virtual void unwatch(int fd) = 0;
+   virtual TimerId schedule(uint64_t delay_us, Callback on_expiry) = 0;
+   virtual void cancel(TimerId timer) = 0;
+   virtual void run() = 0;
+   virtual void stop() = 0;
+};
+
+#endif /* INCLUDE_MFTPEVENTLOOP_H_ */
@@ -0,0 +1,82 @@
+/**
+ * MftpFountain.h implements the LT (Luby Transform) fountain code used by the carousel mode. A source block of K
+ * symbols is turned into an unbounded stream of encoded symbols; each encoded symbol is the XOR of a pseudo-random set
+ * of source symbols, chosen from its 32-bit seed with the robust soliton degree distribution. Any slightly more than K
+ * encoded symbols let the receiver recover the block by peeling (belief propagation), whichever symbols were lost.
+ *
+ * Encoder and decoder derive the symbol neighbours from the seed with the same portable generator, so both sides agree
+ * on every host.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPFOUNTAIN_H_
+#define INCLUDE_MFTPFOUNTAIN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The degree distribution and neighbour selection shared by the encoder and the decoder of one block size.
+ */
+class LtCode {
+public:
+   LtCode(uint32_t source_symbols, size_t symbol_size);
+
+   uint32_t source_symbols() const { return K; }
+   size_t symbol_size() const { return size; }
+   void neighbours(uint32_t seed, std::vector<uint32_t> &out) const;
+
+protected:
+   uint32_t K;
+   size_t size;
+   std::vector<double> degree_cdf; // degree_cdf[d - 1] = P(degree <= d)
+
+   static void xor_into(char *dst, const char *src, size_t len);
+};
+
+/**
+ * Encoder for one source block. The block is referenced, not copied; the last symbol is zero-padded.
+ */
+class LtEncoder : public LtCode {
+public:
+   LtEncoder(const char *block, size_t block_len, size_t symbol_size);
+   void encode(uint32_t seed, char *out) const;
+
+private:
+   const char *block;
+   size_t block_len;
+};
+
+/**
+ * Peeling decoder for one source block. Encoded symbols are reduced by the source symbols already known; a symbol
+ * reduced to a single neighbour recovers it, which may in turn release other buffered symbols.
+ */
+class LtDecoder : public LtCode {
+public:
+   LtDecoder(size_t block_len, size_t symbol_size);
+   bool add(uint32_t seed, const char *data);
+   bool complete() const { return known_count == K; }
+   const char *data() const { return source.data(); }
+   uint32_t received() const { return received_count; }
+
+private:
+   struct Symbol {
+      std::vector<uint32_t> unknown; // Neighbours not yet recovered
+      std::vector<char> data;
+   };
+
+   std::vector<char> source;
+   std::vector<bool> known;
+   uint32_t known_count, received_count;
+   std::vector<Symbol> buffered;
+   std::vector<std::vector<size_t>> waiting; // Per source symbol: buffered symbols that still include it
+
+   void recover(uint32_t index, const char *data);
+};
+
+#endif /* INCLUDE_MFTPFOUNTAIN_H_ */
@@ -0,0 +1,148 @@
+/**
+ * MftpLogger.h implements a levelled, asynchronous console logger for the transfer hot paths. A record for a disabled
+ * level costs one relaxed load and a compare. Enabled records are stored as fixed-size binary records (a static format
+ * string plus up to MAX_ARGS scalar arguments) in a lock-free bounded ring buffer; a background thread formats them,
+ * colors them like the UDP_Communicator print methods, and writes them in batches.
+ *
+ * Format strings use "{}" as the placeholder for each argument, and must be string literals (only the pointer is
+ * stored). String arguments must likewise outlive the record, so only pass literals.
+ *
+ * All console output (the logger's and the UDP_Communicator print methods') goes to console(), which is std::cout
+ * unless it carries data (eg a server streaming to stdout), in which case it is switched to std::cerr.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPLOGGER_H_
+#define INCLUDE_MFTPLOGGER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+class MftpLogger {
+public:
+   enum Level { NONE = -1, ERROR = 0, WARNING = 1, INFO = 2, VERBOSE = 3 };
+
+   static MftpLogger &instance();
+
+   void set_level(Level level) { threshold.store(level, std::memory_order_relaxed); }
+   bool enabled(Level level) const { return level <= threshold.load(std::memory_order_relaxed); }
+   static bool parse_level(const std::string &name, Level &level);
+
+   // Console stream; set before the transfer starts
+   void set_console(std::ostream &stream) { console_stream.store(&stream, std::memory_order_release); }
+   std::ostream &console() const { return *console_stream.load(std::memory_order_acquire); }
+
+   /**
+    * Enqueue a record if the level is enabled. Never blocks; if the ring is full the record is counted and dropped.
+    * @param level severity of this record
+    * @param fmt string literal with one "{}" per argument
+    * @param args up to MAX_ARGS integer, floating point, or string literal arguments
+    */
+   template<typename... Args>
+   void log(Level level, const char *fmt, Args... args) {
+      static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments for a log record");
+      if (!enabled(level))
+         return;
+
+      Arg packed[MAX_ARGS];
+      pack(packed, args...);
+      enqueue(level, fmt, packed, sizeof...(Args));
+   }
+
+   void flush();
+
+private:
+   static const int MAX_ARGS = 4;
+   static const size_t RING_SIZE = 4096; // Must be a power of two
+
+   struct Arg {
+      enum Type : uint8_t { SIGNED, UNSIGNED, FLOAT, STRING } type;
+      union {
+         long long i;
+         unsigned long long u;
+         double d;
+         const char *s;
+      };
+   };
+
+   struct Record {
+      std::atomic<size_t> sequence;
+      uint8_t level;
+      uint8_t nargs;
+      const char *fmt;
+      Arg args[MAX_ARGS];
+   };
+
+   // Ring buffer (bounded MPMC queue, used here with a single consumer). Producer and consumer indices are kept on
+   // separate cache lines.
+   Record ring[RING_SIZE];
+   alignas(64) std::atomic<size_t> enqueue_pos;
+   alignas(64) std::atomic<size_t> dequeue_pos;
+   alignas(64) std::atomic<size_t> written;
+   std::atomic<uint64_t> dropped;
+   std::atomic<int> threshold;
+   std::atomic<std::ostream *> console_stream;
+
+   std::thread writer;
+   std::atomic<bool> running;
+
+   MftpLogger();
+   ~MftpLogger();
+   MftpLogger(const MftpLogger &) = delete;
+   MftpLogger &operator=(const MftpLogger &) = delete;
+
+   void enqueue(int level, const char *fmt, const Arg *args, int nargs);
+   bool dequeue(Record &out);
+   void writer_loop();
+   static void format(std::string &line, const Record &record);
+
+   // Convert each argument into a tagged scalar
+   static void pack(Arg *) {}
+
+   template<typename T, typename... Rest>
+   static void pack(Arg *out, T first, Rest... rest) {
+      *out = to_arg(first);
+      pack(out + 1, rest...);
+   }
+
+   template<typename T>
+   static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, Arg>::type to_arg(T v) {
+      Arg a;
+      a.type = Arg::SIGNED;
+      a.i = v;
+      return a;
+   }
+
+   template<typename T>
+   static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, Arg>::type to_arg(T v) {
+      Arg a;
+      a.type = Arg::UNSIGNED;
+      a.u = v;
+      return a;
+   }
+
+   template<typename T>
+   static typename std::enable_if<std::is_floating_point<T>::value, Arg>::type to_arg(T v) {
+      Arg a;
+      a.type = Arg::FLOAT;
+      a.d = (double) v;
+      return a;
+   }
+
+   static Arg to_arg(const char *v) {
+      Arg a;
+      a.type = Arg::STRING;
+      a.s = v;
+      return a;
+   }
+};
+
+#endif /* INCLUDE_MFTPLOGGER_H_ */
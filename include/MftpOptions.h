@@ -0,0 +1,63 @@
+/**
+ * MftpOptions.h collects the optional "--name=value" switches shared by the Client and Server executables. Switches may
+ * appear anywhere on the commandline; they are consumed and removed from argv so that the positional arguments can
+ * still be read from the end of the array as before.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPOPTIONS_H_
+#define INCLUDE_MFTPOPTIONS_H_
+
+#include <string>
+#include <cstdint>
+
+#include "MftpLogger.h"
+
+struct MftpOptions {
+   MftpOptions();
+
+   // Live statistics export
+   std::string stats_path;
+   uint32_t stats_interval_ms;
+
+   // Console verbosity of the asynchronous logger
+   MftpLogger::Level log_level;
+
+   // Wire format of client packets (servers accept both)
+   int wire_version;
+
+   // Bandwidth estimate for sizing socket buffers in the handshake
+   uint32_t bandwidth_mbps;
+
+   // Relay tree fan-out (0: the client sends to every server)
+   uint16_t fanout;
+
+   // Peer-assisted loss repair among the servers
+   bool peer_repair;
+
+   // Fountain-coded carousel: encoded symbols per source symbol (0: reliable transfer), and the multicast group a
+   // server joins to receive it
+   double carousel;
+   uint32_t carousel_rounds;
+   std::string group;
+
+   // Multipath: the client's local addresses (comma-separated), and the per-source impairments a server applies
+   std::string local;
+   std::string impair;
+
+   // Performance counter and phase profiling
+   bool profile;
+
+   // Binary packet trace, and the capacity of its ring in records
+   std::string trace_path;
+   uint64_t trace_records;
+
+   bool parse(int &argc, char *argv[]);
+   static void usage();
+};
+
+#endif /* INCLUDE_MFTPOPTIONS_H_ */
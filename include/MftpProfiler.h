@@ -0,0 +1,72 @@
+/**
+ * MftpProfiler.h implements the optional profiling mode for MultiFTP Clients and Servers. It reads hardware and
+ * software performance counters for the transfer thread through perf_event_open (cycles, instructions, cache misses,
+ * context switches), accumulates wall time per transfer phase with scoped timers, and counts the socket system calls
+ * issued by the protocol. The report gives cycles per packet, syscalls per MiB and the phase breakdown, so that MSS and
+ * fan-out experiments can tell CPU, syscall and network limits apart.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPPROFILER_H_
+#define INCLUDE_MFTPPROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+
+class MftpProfiler {
+public:
+   enum Phase { PACKETIZE, CHECKSUM, SEND, ACK_WAIT, RECEIVE, DISK_WRITE, PHASE_COUNT };
+   enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, CONTEXT_SWITCHES, COUNTER_COUNT };
+
+   MftpProfiler();
+   ~MftpProfiler();
+
+   void start();
+   void stop();
+   void report();
+
+   void add_phase_time(Phase phase, std::chrono::steady_clock::duration elapsed) { phase_time[phase] += elapsed; }
+   void count_syscalls(uint64_t n = 1) { syscalls += n; }
+   void count_packet(uint64_t payload_bytes) {
+      ++packets;
+      bytes += payload_bytes;
+   }
+
+/**
+ * Accumulate the wall time of the enclosing scope into a phase. A null profiler makes the timer a no-op, so call sites
+ * cost a single branch when profiling is disabled.
+ */
+   class ScopedPhase {
+   public:
+      ScopedPhase(MftpProfiler *profiler, Phase phase) : profiler(profiler), phase(phase) {
+         if (profiler)
+            begin = std::chrono::steady_clock::now();
+      }
+
+      ~ScopedPhase() {
+         if (profiler)
+            profiler->add_phase_time(phase, std::chrono::steady_clock::now() - begin);
+      }
+
+   private:
+      MftpProfiler *profiler;
+      Phase phase;
+      std::chrono::steady_clock::time_point begin;
+   };
+
+private:
+   int counter_fd[COUNTER_COUNT];
+   uint64_t counter_value[COUNTER_COUNT];
+   std::chrono::steady_clock::duration phase_time[PHASE_COUNT];
+   std::chrono::steady_clock::time_point start_time, stop_time;
+   uint64_t syscalls, packets, bytes;
+   bool running;
+
+   static int open_counter(uint32_t type, uint64_t config);
+};
+
+#endif /* INCLUDE_MFTPPROFILER_H_ */
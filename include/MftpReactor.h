@@ -0,0 +1,72 @@
+/**
+ * MftpReactor.h implements the single-threaded event loop that drives asynchronous transfers (MftpAsync.h) on the real
+ * network (see MftpEventLoop.h). Sockets
+ * are watched with epoll and call back when they become readable; timers are kept in a timer wheel (MftpTimerWheel.h)
+ * with microsecond ticks and fire through a timerfd, so that retransmission timeouts of a few tens of microseconds are
+ * honoured (epoll_wait() alone only resolves milliseconds) and thousands of transfers can each keep a timer armed.
+ *
+ * The monotonic clock is read once per loop iteration: the timers due at that time fire together after the socket
+ * callbacks, and timers scheduled by callbacks count their delay from it.
+ *
+ * Callbacks run on the thread that calls run()/run_once(); they may watch and unwatch sockets and schedule and cancel
+ * timers, and must not block.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPREACTOR_H_
+#define INCLUDE_MFTPREACTOR_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "MftpEventLoop.h"
+#include "MftpTimerWheel.h"
+
+class MftpReactor : public MftpEventLoop {
+public:
+   MftpReactor();
+   ~MftpReactor() override;
+   MftpReactor(const MftpReactor &) = delete;
+   MftpReactor &operator=(const MftpReactor &) = delete;
+
+   bool watch(int fd, Callback on_readable) override;
+   void unwatch(int fd) override;
+   TimerId schedule(uint64_t delay_us, Callback on_expiry) override;
+   void cancel(TimerId timer) override;
+
+   void run() override;
+   bool run_once(int max_wait_ms);
+   void stop() override { stopped = true; }
+   bool idle() const { return watched.empty() && timers.empty(); }
+
+private:
+   static const int MAX_EVENTS = 64;
+
+   // A scheduled callback; the generation makes the ids of fired and cancelled timers stale
+   struct Timer {
+      MftpTimerWheel::TimerId wheel_timer;
+      uint32_t generation;
+      bool active;
+      Callback callback;
+   };
+
+   int epoll_fd, timer_fd;
+   bool stopped, in_loop;
+   std::unordered_map<int, Callback> watched;
+   MftpTimerWheel timers; // Payloads are TimerIds
+   std::vector<Timer> timer_slots; // Indexed by the low 32 bits of the TimerId
+   std::vector<uint32_t> free_slots;
+   std::vector<uint64_t> expired;
+   uint64_t loop_us, timer_fd_us; // The clock read of this iteration, and the time the timerfd is armed for
+
+   static uint64_t now_us();
+   void arm_timer_fd();
+   void fire_timers();
+};
+
+#endif /* INCLUDE_MFTPREACTOR_H_ */
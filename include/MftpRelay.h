@@ -0,0 +1,76 @@
+/**
+ * MftpRelay.h implements the forwarding side of relay-tree distribution. A server that is given a subtree in a
+ * RELAY_SETUP packet hands every in-order payload to its relay, which forwards the stream to the server's children with
+ * an embedded MftpClient on a separate thread (store-and-forward, pipelined packet by packet). The queue between the
+ * two is bounded: when it is full, the server withholds its ACK so that backpressure propagates up the tree.
+ *
+ * A server driven by an event loop (MftpAsyncReceiver) may instead run its relay on the same loop, through the
+ * server's transport: the client's handshake and transfer are then an MftpAsyncHandshake and an MftpAsyncSender. This
+ * is how relay trees run on a simulated network (MftpSimNet).
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPRELAY_H_
+#define INCLUDE_MFTPRELAY_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "MftpChunkQueue.h"
+#include "MftpEventLoop.h"
+
+class MftpClient;
+class MftpAsyncHandshake;
+class MftpAsyncSender;
+class MftpTransport;
+
+class MftpRelay {
+public:
+   MftpRelay(const std::vector<sockaddr_in> &subtree, uint16_t fanout, bool peer_repair);
+   MftpRelay(const std::vector<sockaddr_in> &subtree, uint16_t fanout, bool peer_repair, MftpEventLoop &loop,
+             MftpTransport &transport);
+   ~MftpRelay();
+
+   bool accepts(size_t len) { return setup_failed || queue.accepts(len); }
+   bool offer(const char *data, size_t len);
+   void finish();
+   bool done() const { return !forwarding; } // Event loop: the stream is forwarded (see on_done())
+   void on_done(MftpEventLoop::Callback callback) { done_callback = callback; }
+   bool failed() const { return setup_failed; }
+
+private:
+   static const size_t QUEUE_BYTES = 4 << 20;
+   static const uint32_t BANDWIDTH_MBPS = 100;
+
+   std::vector<sockaddr_in> subtree;
+   uint16_t fanout;
+   bool peer_repair;
+   std::atomic<bool> setup_failed; // The handshake or relay setup with our subtree failed; the stream is discarded
+   bool forwarding; // Event loop: the stream is not completely forwarded yet
+
+   MftpChunkQueue queue;
+   std::thread worker;
+
+   // Event loop mode: the loop, the client and its handshake and transfer, and the completion callback
+   MftpEventLoop *loop;
+   std::unique_ptr<MftpClient> client;
+   std::unique_ptr<MftpAsyncHandshake> handshake;
+   std::unique_ptr<MftpAsyncSender> sender;
+   MftpEventLoop::Callback done_callback;
+   MftpEventLoop::TimerId done_timer;
+
+   void run();
+   void handshaken(bool negotiated);
+   void forwarded();
+};
+
+#endif /* INCLUDE_MFTPRELAY_H_ */
@@ -2,7 +2,10 @@
  * MftpServer.h class inherits all member functions from the UDP_Communicator superclass, and implements the rdt_receive()
  * (Reliable Data Transfer Receive) API which receives packets from a remote client, checksums the packets for
  * validity and in-orderness, and returns ACKs to the client when appropriate. The class also implements a
- * probabilistic loss service to simulate lossy connections for performance experiments.
+ * probabilistic loss service to simulate lossy connections for performance experiments. In a relay tree, the server
+ * also forwards the stream to its children through an MftpRelay. With peer repair, the server caches recent packets,
+ * serves them to peers that lost them, and asks its peers for the packets it loses. In carousel mode, the server
+ * decodes a fountain-coded stream without sending any feedback, and leaves as soon as the file is complete.
  *
  * Created on: June 23th, 2021
  * Author: Stevan Dupor
@@ -14,6 +17,12 @@
 #define INCLUDE_MFTPSERVER_H
 
 #include "UDP_Communicator.h"
+#include "MftpStats.h"
+#include "MftpRelay.h"
+#include "MftpStreamWriter.h"
+#include "MftpFountain.h"
+
+#include <map>
 
 class MftpServer : public UDP_Communicator {
 private:
@@ -21,24 +30,112 @@ private:
    struct sockaddr_in *remote_sock_addr;
    std::string filename;
    int inbound_socket;
+   int local_port;
    int loss_probability;
-   int bytes_written;
+
+   // Per-source impairments for experiments (eg one per client interface in multipath mode): loss and added delay
+   struct SourceImpairment {
+      in_addr source;
+      int loss_probability;
+      uint32_t delay_us;
+   };
+   std::vector<SourceImpairment> impairments;
+
+   // Packets from delayed sources, held back until they are due (in arrival order for the same time)
+   struct HeldPacket {
+      sockaddr_in sender;
+      std::vector<char> data;
+   };
+   std::multimap<MftpTransport::TimePoint, HeldPacket> held_packets;
+   static const uint64_t TIMER_POLL_US = 100; // rdt_receive() socket polling interval while a timer is pending
+
+   uint64_t bytes_written;
+   uint16_t features; // Optional features advertised in the handshake
 
    // Utility Variables
    uint_fast64_t packet_count;
    uint_fast32_t loss_count;
    std::list<LogItem> local_time_logs;
+   MftpStats stats;
+   MftpRelay *relay; // Forwards to our subtree of a relay tree, if we were given one
+   MftpEventLoop *event_loop; // Runs the relay, if set (see set_event_loop())
+   std::vector<sockaddr_in> relay_subtree; // The RELAY_SETUP host list received so far
+   MftpStreamWriter *stream; // Writes to stdout when the output file is "-"
+   std::ofstream out_file;
+
+   // Statistics: the ACK-to-next-packet time is the RTT as seen from the server
+   std::chrono::steady_clock::time_point last_ack_sent;
+   bool ack_sent;
+   uint16_t upstream_features; // Features our client requested in the handshake
+
+   // Peer-assisted repair: our peers, the most recent packets, and peers waiting for the next packet
+   struct CachedPacket {
+      uint64_t offset;
+      uint16_t len;
+      char payload[MSG_LEN];
+   };
+   static const size_t REPAIR_CACHE_PACKETS = 16;
+   static const size_t MAX_PENDING_REPAIRS = 16;
+   std::vector<sockaddr_in> peers;
+   std::vector<CachedPacket> repair_cache;
+   std::vector<std::pair<sockaddr_in, uint64_t>> pending_repairs;
+   uint_fast64_t repairs_served, repairs_received;
+
+   // Peer repair of real losses: the smoothed ACK-to-next-packet time and its deviation, the repair timer armed after
+   // each ACK, and the offset last asked of our peers (UINT64_MAX: none)
+   double gap_us, gap_dev_us;
+   bool repair_timer_armed;
+   MftpTransport::TimePoint repair_due;
+   uint64_t nacked_offset;
+
+   // Carousel: blocks being decoded (by offset), blocks done, and symbol counts for the decoding overhead
+   std::map<uint64_t, LtDecoder> carousel_blocks;
+   std::vector<bool> carousel_decoded;
+   size_t carousel_blocks_done;
+   uint_fast64_t carousel_symbols, carousel_source_symbols, carousel_used_symbols;
+   static const int CAROUSEL_RECV_BUFFER = 4194304; // Nothing is retransmitted: absorb decoding stalls
 
    // Communication Functions
    bool valid_seq_num();
-   bool valid_checksum();
+   bool valid_checksum(int received_len);
    bool valid_data_pkt_type();
-   bool probability_not_dropped();
+   bool valid_session();
+   bool duplicate_packet(int received_len);
+   bool probability_not_dropped(int received_len);
+   void send_ack(int sockfd, uint16_t flags);
+   bool handle_control(int sockfd, int received_len);
+   bool receive_relay_setup();
+   bool handle_nack(const sockaddr_in &sender, int received_len);
+   void cache_packet(size_t payload_len);
+   void send_repair(const CachedPacket &packet, const sockaddr_in &peer);
+   void request_repair();
+   void update_packet_gap(uint64_t gap_sample);
+   void arm_repair_timer();
+   bool receive_symbol(std::ofstream &fd);
+   bool handle_packet(const sockaddr_in &sender, int n);
+   void trace_packet(MftpTrace::Event event, const sockaddr_in &sender, int received_len, uint8_t detail);
 
 public:
-   MftpServer(std::string &file_path, std::string &logfile, int port, bool verbose, float loss_probability);
+   MftpServer(std::string &file_path, std::string &logfile, int port, bool verbose, float loss_probability,
+              MftpTransport &transport = MftpSocketTransport::instance());
    ~MftpServer() override;
+   void enable_stats(const std::string &path, uint32_t interval_ms);
+   bool enable_trace(const std::string &path, uint64_t records = MftpTrace::DEFAULT_RECORDS);
+   bool join_group(const std::string &group, int port);
+   bool set_impairments(const std::string &spec);
+   void set_event_loop(MftpEventLoop *loop) { event_loop = loop; } // Relays run on it (MftpAsyncReceiver only)
    void rdt_receive();
+
+   // Steps of rdt_receive(), for callers that wait for the socket themselves (MftpAsyncReceiver)
+   void begin_receive();
+   bool receive_packet(int flags);
+   bool run_timers();
+   uint64_t timer_in_us();
+   bool timer_pending() const { return !held_packets.empty() || repair_timer_armed; }
+   bool drain_relay(MftpEventLoop::Callback on_drained);
+   bool end_receive();
+   int socket() const { return inbound_socket; }
+   uint64_t bytes_received() const { return bytes_written; }
    void system_report();
 };
 
@@ -0,0 +1,142 @@
+/**
+ * MftpSimNet.h implements an in-process, discrete-event simulation of a UDP network, so that one process can run a
+ * client against thousands of MftpServer instances, deterministically and faster than real time.
+ *
+ * Every simulated host is an MftpTransport (see add_host()): the clients and servers built on it send and receive
+ * through the simulation and read their protocol timers from its virtual clock. The network is a star: each host has
+ * a link model (latency, jitter, loss, uplink bandwidth) to the core, so a datagram from A to B is serialized on A's
+ * uplink, then delayed by both latencies and jitters, and lost with the loss probability of either link. All the
+ * randomness comes from one seeded generator, so a run is repeatable.
+ *
+ * MftpSimNet is also the MftpEventLoop that drives the transfers (MftpAsyncHandshake / MftpAsyncSender /
+ * MftpAsyncReceiver, and the relays of servers given the loop with MftpServer::set_event_loop()): run() processes
+ * events in virtual time order until none is left. Simulated sockets never block; a receive on an empty socket fails
+ * with EAGAIN. The network has no MTU: path MTU probes of any size get through.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPSIMNET_H_
+#define INCLUDE_MFTPSIMNET_H_
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "MftpEventLoop.h"
+#include "MftpTransport.h"
+
+/**
+ * The link between a simulated host and the network core.
+ */
+struct MftpLinkModel {
+   uint32_t latency_us = 0;     // One-way propagation delay
+   uint32_t jitter_us = 0;      // Extra delay per datagram, uniform in [0, jitter_us] (may reorder datagrams)
+   double loss = 0.0;           // Probability that a datagram sent or received by the host is lost
+   uint32_t bandwidth_mbps = 0; // Uplink rate, datagrams queue behind each other (0: unlimited)
+};
+
+class MftpSimNet : public MftpEventLoop {
+public:
+   explicit MftpSimNet(uint64_t seed);
+   MftpSimNet(const MftpSimNet &) = delete;
+   MftpSimNet &operator=(const MftpSimNet &) = delete;
+
+   MftpTransport &add_host(const in_addr &address, const MftpLinkModel &link);
+
+   bool watch(int fd, Callback on_readable) override;
+   void unwatch(int fd) override;
+   TimerId schedule(uint64_t delay_us, Callback on_expiry) override;
+   void cancel(TimerId timer) override;
+   void run() override;
+   void stop() override { stopped = true; }
+
+   uint64_t now_us() const { return clock_us; }
+   uint64_t datagrams_sent() const { return sent; }
+   uint64_t datagrams_lost() const { return lost; }
+   uint64_t datagrams_overflowed() const { return overflowed; }
+
+private:
+   // Timers never fire sooner than this after being scheduled, like the kernel's default timer slack; it also keeps a
+   // zero retransmission timeout from spinning without virtual time advancing
+   static const uint64_t TIMER_SLACK_US = 50;
+   static const int DEFAULT_RECV_BUFFER = 212992; // Linux net.core.rmem_default
+   static const size_t UDP_IP_HEADERS = 28;
+   static const int FIRST_FD = 3;
+   static const uint16_t FIRST_EPHEMERAL_PORT = 32768;
+
+   /**
+    * A simulated host: the transport its clients and servers are given.
+    */
+   class Host : public MftpTransport {
+   public:
+      Host(MftpSimNet &net, const in_addr &address, const MftpLinkModel &link);
+
+      int open_socket(const sockaddr_in *local, bool shared) override;
+      int close_socket(int sockfd) override;
+      ssize_t send_to(int sockfd, const char *data, size_t len, const sockaddr_in &to) override;
+      ssize_t receive_from(int sockfd, char *data, size_t len, int flags, sockaddr_in *from) override;
+      int set_option(int sockfd, int level, int name, const void *value, socklen_t len) override;
+      int get_option(int sockfd, int level, int name, void *value, socklen_t *len) override;
+      int path_mtu(const sockaddr_in &) override { return 0; } // The network has no MTU
+      TimePoint now() override;
+
+      in_addr address;
+      MftpLinkModel link;
+      uint64_t uplink_free_us; // Virtual time at which the uplink has sent every queued datagram
+      uint16_t next_port;
+
+   private:
+      MftpSimNet &net;
+   };
+
+   struct Datagram {
+      sockaddr_in from;
+      std::vector<char> data;
+   };
+
+   struct Socket {
+      Host *host;
+      sockaddr_in local;
+      std::deque<Datagram> queue;
+      size_t queued_bytes;
+      int recv_buffer;
+      bool open, ready;
+      Callback on_readable;
+   };
+
+   // A pending event: a timer (timer != 0) or the arrival of a datagram at an address
+   struct Event {
+      TimerId timer;
+      sockaddr_in to;
+      Datagram datagram;
+   };
+
+   typedef std::pair<uint32_t, uint16_t> Binding; // Address and port, in network byte order
+
+   std::mt19937_64 random;
+   uint64_t clock_us;
+   bool stopped;
+   std::vector<std::unique_ptr<Host>> hosts;
+   std::unordered_map<uint32_t, Host *> host_addresses;
+   std::vector<Socket> sockets; // Indexed by fd - FIRST_FD; closed sockets are kept so that fds are never reused
+   std::map<Binding, int> bindings;
+   std::multimap<uint64_t, Event> events; // By virtual time; events of the same time stay in insertion order
+   std::unordered_map<TimerId, Callback> timers;
+   std::vector<int> ready;
+   TimerId next_timer;
+   uint64_t sent, lost, overflowed;
+
+   Socket *socket(int fd);
+   bool chance(double probability);
+   void deliver(Event &event);
+   void dispatch_readable();
+};
+
+#endif /* INCLUDE_MFTPSIMNET_H_ */
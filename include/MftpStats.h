@@ -0,0 +1,100 @@
+/**
+ * MftpStats.h holds the live transfer statistics for MultiFTP Clients and Servers: HDR-style latency histograms and
+ * counters per remote host, plus transfer-wide counters for throughput, retransmissions and window occupancy. All
+ * counters are updated with relaxed atomics from the transfer thread, and an optional exporter thread periodically
+ * writes a JSON snapshot to disk while the transfer runs.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPSTATS_H_
+#define INCLUDE_MFTPSTATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Log-linear latency histogram in microseconds. Values below 2 * SUB_BUCKETS are recorded exactly; above that, each
+ * power-of-two range is split into SUB_BUCKETS equal buckets, giving a worst-case relative error of 1 / SUB_BUCKETS.
+ */
+class LatencyHistogram {
+public:
+   static const int SUB_BUCKET_BITS = 4;
+   static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+   static const int MAX_VALUE_BITS = 36; // ~19 hours in microseconds
+   static const int BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+   LatencyHistogram();
+   void record(uint64_t value_us);
+   uint64_t count() const;
+   uint64_t percentile(double p) const;
+   std::string to_json() const;
+
+private:
+   std::atomic<uint64_t> counts[BUCKETS];
+   std::atomic<uint64_t> total, sum, min, max;
+
+   static int bucket_index(uint64_t value);
+   static uint64_t bucket_value(int index);
+};
+
+/**
+ * Statistics for a single remote host.
+ */
+struct HostStats {
+   explicit HostStats(const std::string &name);
+
+   std::string name;
+   LatencyHistogram rtt, ack_latency;
+   std::atomic<uint64_t> packets_sent, retransmissions, acks;
+};
+
+class MftpStats {
+public:
+   explicit MftpStats(const std::string &role);
+   ~MftpStats();
+
+   HostStats &add_host(const std::string &name);
+   HostStats &host(size_t index) { return hosts[index]; }
+
+   void add(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+      counter.fetch_add(value, std::memory_order_relaxed);
+   }
+   void set_window_occupancy(uint64_t occupancy);
+
+   std::string to_json() const;
+   void start_export(const std::string &path, uint32_t interval_ms);
+   void stop_export();
+
+   // Transfer-wide counters
+   std::atomic<uint64_t> packets_sent, packets_received, payload_bytes, retransmissions, timeouts, drops;
+   std::atomic<uint64_t> peer_repairs; // Packets delivered by a peer server instead of the client
+   std::atomic<uint64_t> receiver_stalls; // Packets a receiver could not take because its output queue was full
+   std::atomic<uint64_t> window_occupancy, window_occupancy_max;
+
+private:
+   std::string role;
+   std::deque<HostStats> hosts;
+   std::chrono::steady_clock::time_point start_time;
+
+   // Exporter thread state
+   std::thread exporter;
+   std::mutex export_mutex;
+   std::condition_variable export_cv;
+   bool exporting;
+   std::string export_path;
+
+   static std::string json_string(const std::string &text);
+   void export_loop(uint32_t interval_ms);
+   void write_snapshot();
+};
+
+#endif /* INCLUDE_MFTPSTATS_H_ */
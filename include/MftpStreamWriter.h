@@ -0,0 +1,43 @@
+/**
+ * MftpStreamWriter.h implements the server's streaming sink ("-" as the output file). In-order payloads are queued by
+ * the receiving thread and written to a file descriptor (stdout) by a writer thread, coalescing whatever has queued up
+ * into one writev() call. The queue is bounded: when the consumer of the stream falls behind, the server stops
+ * acknowledging data, so that the sender is slowed down by the protocol rather than by our memory.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPSTREAMWRITER_H_
+#define INCLUDE_MFTPSTREAMWRITER_H_
+
+#include <atomic>
+#include <thread>
+
+#include "MftpChunkQueue.h"
+
+class MftpStreamWriter {
+public:
+   explicit MftpStreamWriter(int fd);
+   ~MftpStreamWriter();
+
+   bool accepts(size_t len) { return queue.accepts(len); }
+   bool offer(const char *data, size_t len);
+   void finish();
+   bool failed() const { return write_failed.load(std::memory_order_relaxed); }
+
+private:
+   static const size_t QUEUE_BYTES = 4 << 20;
+
+   int fd;
+   MftpChunkQueue queue;
+   std::atomic<bool> write_failed;
+   std::thread worker;
+
+   void run();
+   bool write_chunks(std::vector<std::string> &chunks);
+};
+
+#endif /* INCLUDE_MFTPSTREAMWRITER_H_ */
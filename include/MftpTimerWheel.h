@@ -0,0 +1,72 @@
+/**
+ * MftpTimerWheel.h implements a hierarchical timer wheel for large numbers of retransmission deadlines: arming and
+ * cancelling a timer are O(1), and expired timers are collected in batches by advance(), which the owner calls with
+ * the time it read once per loop iteration.
+ *
+ * Time is counted in ticks (the owner's unit, eg microseconds). The wheel has LEVELS levels of SLOTS slots; level l
+ * holds the timers due in [SLOTS^l, SLOTS^(l+1)) ticks, in the slot of their expiry at that level's granularity.
+ * When the clock reaches a slot of an upper level, its timers cascade to the levels below, so every timer is moved at
+ * most LEVELS times. Occupancy bitmaps let advance() jump straight to the next occupied slot, so an idle wheel costs
+ * nothing however far the clock moves. Timers due beyond the span of the top level (2^32 ticks) wait in its last slot
+ * and are re-filed when it comes up.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPTIMERWHEEL_H_
+#define INCLUDE_MFTPTIMERWHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MftpTimerWheel {
+public:
+   typedef uint64_t TimerId; // Never 0
+
+   explicit MftpTimerWheel(uint64_t now = 0);
+
+   TimerId arm(uint64_t expiry, uint64_t payload);
+   bool cancel(TimerId timer, uint64_t *payload = nullptr);
+   size_t advance(uint64_t now, std::vector<uint64_t> &expired);
+   uint64_t next_visit() const;
+
+   uint64_t now() const { return current; }
+   size_t size() const { return armed; }
+   bool empty() const { return armed == 0; }
+
+   static const uint64_t NEVER = ~(uint64_t) 0;
+
+private:
+   static const unsigned SLOT_BITS = 8;
+   static const unsigned SLOTS = 1 << SLOT_BITS;
+   static const unsigned LEVELS = 4;
+   static const unsigned WORDS = SLOTS / 64;
+   static const uint32_t NIL = ~(uint32_t) 0;
+
+   // A timer; free nodes are chained through `next`. The generation makes the ids of freed nodes stale.
+   struct Node {
+      uint64_t expiry, payload;
+      uint32_t prev, next, generation;
+      uint16_t slot; // Level * SLOTS + slot index
+      bool armed;
+   };
+
+   uint64_t current;
+   size_t armed;
+   std::vector<Node> nodes;
+   uint32_t free_nodes;
+   uint32_t heads[LEVELS * SLOTS];
+   uint64_t occupied[LEVELS][WORDS];
+
+   void file(uint32_t index);
+   void unlink(uint32_t index);
+   void release(uint32_t index);
+   void visit(uint64_t tick, std::vector<uint64_t> &expired);
+   static int next_occupied(const uint64_t *bits, unsigned start);
+};
+
+#endif /* INCLUDE_MFTPTIMERWHEEL_H_ */
@@ -0,0 +1,118 @@
+/**
+ * MftpTrace.h implements the optional binary packet trace of MultiFTP Clients and Servers: every data packet sent,
+ * retransmitted, received, dropped or acknowledged, and every retransmission timeout, is appended as a fixed-size
+ * record to a ring in a memory-mapped file. Recording a packet is a store into the mapping (no system call and no
+ * formatting), and the file is valid at every point of the transfer, so the trace of a process that crashed or was
+ * killed can still be read. TraceReplay reconstructs timelines, goodput and retransmission causes from the traces.
+ *
+ * File layout: a Header, followed by `capacity` Records. Once `written` exceeds the capacity, the ring holds the last
+ * `capacity` records, the oldest at index written % capacity.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPTRACE_H_
+#define INCLUDE_MFTPTRACE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+class MftpTrace {
+public:
+   enum Role { CLIENT = 1, SERVER = 2 };
+
+   // Client events: SEND to one host, RETRANSMIT to one host (detail: Cause), TIMEOUT of the packet in flight (hosts:
+   // the hosts still outstanding), ACK_RECEIVED from one host (detail: AckFlags), STALL (backpressure ACK) from one
+   // host. Server events: RECEIVE of the next packet (detail: AckFlags::REPAIRED if a peer sent it), DUPLICATE of a
+   // packet already received, DROP (detail: DropReason), ACK_SENT (offset and seq: the next expected; detail: AckFlags).
+   enum Event {
+      SEND = 1, RETRANSMIT = 2, TIMEOUT = 3, ACK_RECEIVED = 4, STALL = 5, RECEIVE = 6, DUPLICATE = 7, DROP = 8,
+      ACK_SENT = 9, EVENT_COUNT
+   };
+   enum Cause { BY_TIMEOUT = 1, BY_PERSIST = 2 };
+   enum DropReason { LOSS = 1, CHECKSUM = 2, BACKPRESSURE = 3 };
+   enum AckFlags { REPAIRED = 1 << 0, HELD = 1 << 1 };
+
+   static const uint64_t DEFAULT_RECORDS = 1 << 20; // 32 MiB
+   static const uint64_t MAX_RECORDS = 1 << 28;     // 8 GiB
+
+   struct Header {
+      char magic[8];           // MAGIC
+      uint32_t record_size;    // sizeof(Record)
+      uint32_t role;           // Role
+      uint64_t capacity;       // Records in the ring (a power of two)
+      uint64_t written;        // Records written since the trace was opened
+      int64_t clock_offset_us; // CLOCK_REALTIME minus the protocol clock, to align the traces of several processes
+      uint32_t port;           // Server: the port it is bound to. Client: the default port of its servers.
+      uint32_t pid;
+      uint64_t boot_id;        // From the kernel's boot ID: traces of one boot share CLOCK_MONOTONIC (0 if unknown)
+      uint64_t reserved;
+   };
+
+   struct Record {
+      uint64_t time_us; // Protocol clock (CLOCK_MONOTONIC, or virtual time on a simulated network)
+      uint64_t offset;  // Stream offset of the packet's first byte
+      uint32_t seq;     // Sequence number of the packet
+      uint32_t address; // Remote IPv4 address, network byte order (0 for TIMEOUT)
+      uint16_t port;    // Remote port, network byte order
+      uint16_t length;  // Payload bytes
+      uint8_t event;    // Event
+      uint8_t detail;   // Cause, DropReason or AckFlags
+      uint16_t hosts;   // TIMEOUT: the hosts that have not acknowledged the packet, at most 65535 (0 for other events)
+   };
+
+   MftpTrace();
+   ~MftpTrace();
+   MftpTrace(const MftpTrace &) = delete; // Owns the file and its mapping
+   MftpTrace &operator=(const MftpTrace &) = delete;
+
+   bool open(const std::string &path, uint64_t records, Role role, int port, int64_t clock_offset_us);
+   void close();
+
+/**
+ * Append a record to the ring.
+ * @param event the Event
+ * @param time_us the protocol clock in microseconds
+ * @param peer the remote host
+ * @param seq the sequence number of the packet
+ * @param offset the stream offset of the packet's first byte
+ * @param length the payload bytes
+ * @param detail the Cause, DropReason or AckFlags of the event
+ * @param hosts the hosts outstanding at a TIMEOUT
+ */
+   void record(Event event, uint64_t time_us, const sockaddr_in &peer, uint32_t seq, uint64_t offset,
+               uint16_t length, uint8_t detail, uint16_t hosts = 0) {
+      Record &r = ring[header->written & mask];
+      r.time_us = time_us;
+      r.offset = offset;
+      r.seq = seq;
+      r.address = peer.sin_addr.s_addr;
+      r.port = peer.sin_port;
+      r.length = length;
+      r.event = (uint8_t) event;
+      r.detail = detail;
+      r.hosts = hosts;
+      ++header->written;
+   }
+
+   static bool read(const std::string &path, Header &header, std::vector<Record> &records, std::string &problem);
+   static const char *event_name(uint8_t event);
+
+private:
+   static const char MAGIC[8];
+   static uint64_t read_boot_id();
+
+   int fd;
+   Header *header;
+   Record *ring;
+   uint64_t mask;
+   size_t mapped_bytes;
+};
+
+#endif /* INCLUDE_MFTPTRACE_H_ */
@@ -0,0 +1,63 @@
+/**
+ * MftpTransport.h implements the socket layer under UDP_Communicator: datagram sockets, their options, and the clock
+ * that protocol timers are measured with. MftpSocketTransport is the real network (the default); MftpSimNet
+ * implements the same interface over an in-process simulated network with virtual time.
+ *
+ * Sockets are identified by int descriptors that are only meaningful to the transport that opened them.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPTRANSPORT_H_
+#define INCLUDE_MFTPTRANSPORT_H_
+
+#include <chrono>
+#include <cstddef>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+class MftpTransport {
+public:
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+   virtual ~MftpTransport() {}
+
+   /**
+    * Open a UDP socket.
+    * @param local the address to bind (nullptr: unbound, the transport picks the local address and port)
+    * @param shared allow other sockets to bind the same address (SO_REUSEADDR)
+    * @return the socket, or -1 on failure (errno is set)
+    */
+   virtual int open_socket(const sockaddr_in *local, bool shared) = 0;
+   virtual int close_socket(int sockfd) = 0;
+   virtual ssize_t send_to(int sockfd, const char *data, size_t len, const sockaddr_in &to) = 0;
+   virtual ssize_t receive_from(int sockfd, char *data, size_t len, int flags, sockaddr_in *from) = 0;
+   virtual int set_option(int sockfd, int level, int name, const void *value, socklen_t len) = 0;
+   virtual int get_option(int sockfd, int level, int name, void *value, socklen_t *len) = 0;
+   virtual int path_mtu(const sockaddr_in &to) = 0; // The current path MTU estimate towards an address (0: unknown)
+   virtual TimePoint now() = 0;
+};
+
+/**
+ * The real network: every call maps to the corresponding system call, and time is std::chrono::steady_clock.
+ */
+class MftpSocketTransport : public MftpTransport {
+public:
+   static MftpSocketTransport &instance();
+
+   int open_socket(const sockaddr_in *local, bool shared) override;
+   int close_socket(int sockfd) override;
+   ssize_t send_to(int sockfd, const char *data, size_t len, const sockaddr_in &to) override;
+   ssize_t receive_from(int sockfd, char *data, size_t len, int flags, sockaddr_in *from) override;
+   int set_option(int sockfd, int level, int name, const void *value, socklen_t len) override;
+   int get_option(int sockfd, int level, int name, void *value, socklen_t *len) override;
+   int path_mtu(const sockaddr_in &to) override;
+   TimePoint now() override { return std::chrono::steady_clock::now(); }
+};
+
+#endif /* INCLUDE_MFTPTRANSPORT_H_ */
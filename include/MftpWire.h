@@ -0,0 +1,257 @@
+/**
+ * MftpWire.h defines the version 2 MultiFTP packet header and a zero-copy view for reading and writing it in place in
+ * a packet buffer. The v2 header carries a version, flags, a session ID, an explicit payload length and a 64-bit byte
+ * offset, so that receivers checksum only the bytes actually sent and file size is no longer capped by a 32-bit
+ * sequence number. All multi-byte fields are big-endian (network order).
+ *
+ * The checksum field sits at the same position as in the legacy 8-byte header, and the marker field overlaps the
+ * legacy packet type with a value legacy hosts never send, so a legacy receiver silently discards v2 packets and a v2
+ * receiver can tell the two formats apart from the first packet.
+ *
+ * SYN and SYN_ACK packets carry a WireCapabilities payload, used by the handshake to negotiate the segment size,
+ * socket buffer sizes and optional protocol features. RELAY_SETUP packets carry a WireRelaySetup payload describing
+ * the part of the distribution tree a server forwards to; PEER_SETUP packets use the same layout to give a server the
+ * peers it may ask for repairs. CAROUSEL packets carry a WireCarouselSymbol prefix followed by one encoded symbol.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#ifndef INCLUDE_MFTPWIRE_H_
+#define INCLUDE_MFTPWIRE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <endian.h>
+
+/**
+ * Fixed layout of the v2 header. Never accessed directly (the buffers are not aligned and the fields are big-endian);
+ * it only provides the compile-time checked offsets and sizes used by WireHeaderV2View.
+ */
+struct WireHeaderV2 {
+   uint8_t version;
+   uint8_t type;
+   uint16_t flags;
+   uint16_t checksum;
+   uint16_t marker;
+   uint32_t session_id;
+   uint16_t payload_len;
+   uint16_t reserved;
+   uint64_t offset;
+
+   static const uint8_t VERSION = 2;
+   static const uint16_t MARKER = 0x3232;
+
+   // Flags
+   static const uint16_t FLAG_CONFIRM = 1 << 0;     // SYN: confirms the negotiated parameters
+   static const uint16_t FLAG_PEER_REPAIR = 1 << 1; // DATA: repair sent by a peer; ACK: the data came from a peer
+   static const uint16_t FLAG_BACKPRESSURE = 1 << 2; // ACK: the receiver could not take the data at offset yet
+   static const uint16_t FLAG_MORE = 1 << 3;         // RELAY_SETUP/PEER_SETUP: more of the host list follows
+};
+
+static_assert(std::is_standard_layout<WireHeaderV2>::value, "WireHeaderV2 must have a fixed layout");
+static_assert(sizeof(WireHeaderV2) == 24, "WireHeaderV2 must be 24 bytes on the wire");
+static_assert(offsetof(WireHeaderV2, checksum) == 4, "v2 checksum must overlay the legacy checksum");
+static_assert(offsetof(WireHeaderV2, marker) == 6, "v2 marker must overlay the legacy packet type");
+static_assert(offsetof(WireHeaderV2, offset) == 16, "v2 offset must be naturally aligned");
+
+/**
+ * Fixed layout of the handshake payload (SYN/SYN_ACK). Each side advertises its receive buffer, the largest payload it
+ * accepts, and bitmasks of the optional features and checksum types it supports. In the confirming SYN, the client
+ * also states the MSS it selected and the receive buffer it wants the server to use.
+ */
+struct WireCapabilities {
+   uint32_t recv_buffer;
+   uint16_t max_segment;
+   uint16_t features;
+   uint16_t checksum_types;
+   uint16_t selected_mss;
+
+   // Optional protocol features
+   static const uint16_t FEATURE_WINDOW = 1 << 0;
+   static const uint16_t FEATURE_FEC = 1 << 1;
+   static const uint16_t FEATURE_COMPRESSION = 1 << 2;
+   static const uint16_t FEATURE_RELAY = 1 << 3;
+   static const uint16_t FEATURE_PEER_REPAIR = 1 << 4;
+
+   // Checksum types
+   static const uint16_t CHECKSUM_LEGACY_BYTES = 1 << 0; // Legacy byte-sum over the full buffer
+   static const uint16_t CHECKSUM_V2_WORDS = 1 << 1;     // v2 16-bit word sum over header and payload
+};
+
+static_assert(std::is_standard_layout<WireCapabilities>::value, "WireCapabilities must have a fixed layout");
+static_assert(sizeof(WireCapabilities) == 12, "WireCapabilities must be 12 bytes on the wire");
+
+/**
+ * Fixed layout of the relay setup payload: the tree fan-out and the number of hosts in the receiving server's subtree,
+ * followed by that many WireRelayHost entries. The hosts are listed in breadth-first order with the receiving server
+ * as the implicit root, so its children are the first `fanout` entries and the list forms a k-ary heap. A PEER_SETUP
+ * payload has a fan-out of 0 and lists the server's repair peers. A list too long for one packet is split: the header
+ * offset is the index of the packet's first host, every packet but the last has FLAG_MORE set, and each is
+ * acknowledged (with the same offset) before the next is sent.
+ */
+struct WireRelaySetup {
+   uint16_t fanout;
+   uint16_t count;
+};
+
+struct WireRelayHost {
+   uint32_t address; // IPv4 address, network order
+   uint16_t port;    // network order
+};
+
+static_assert(sizeof(WireRelaySetup) == 4, "WireRelaySetup must be 4 bytes on the wire");
+static_assert(sizeof(WireRelayHost) == 8 && offsetof(WireRelayHost, port) == 4, "WireRelayHost layout");
+
+/**
+ * Fixed prefix of a carousel (fountain-coded) symbol. The header offset is the byte offset of the symbol's source block;
+ * together with the file size and nominal block size it gives the block's length, and the seed selects the source
+ * symbols the encoded symbol combines. The symbol size is the rest of the payload.
+ */
+struct WireCarouselSymbol {
+   uint64_t file_size;
+   uint32_t block_bytes;
+   uint32_t seed;
+};
+
+static_assert(sizeof(WireCarouselSymbol) == 16, "WireCarouselSymbol must be 16 bytes on the wire");
+
+/**
+ * Base for the zero-copy views: holds only the buffer pointer and provides unaligned big-endian field access.
+ */
+class WireView {
+public:
+   explicit WireView(char *buffer) : buffer(buffer) {}
+
+protected:
+   char *buffer;
+
+   uint8_t get8(size_t at) const { return (uint8_t) buffer[at]; }
+   void set8(size_t at, uint8_t v) { buffer[at] = (char) v; }
+
+   template<typename T>
+   T get(size_t at) const {
+      T v;
+      memcpy(&v, buffer + at, sizeof(T));
+      return v;
+   }
+
+   template<typename T>
+   void set(size_t at, T v) { memcpy(buffer + at, &v, sizeof(T)); }
+};
+
+/**
+ * Read/write view of a v2 header at the start of a packet buffer. Every accessor converts between host and network
+ * byte order.
+ */
+class WireHeaderV2View : public WireView {
+public:
+   static const size_t SIZE = sizeof(WireHeaderV2);
+
+   explicit WireHeaderV2View(char *buffer) : WireView(buffer) {}
+
+   // True if the buffer holds a v2 header (as opposed to a legacy 8-byte header)
+   bool is_v2() const { return version() == WireHeaderV2::VERSION && marker() == WireHeaderV2::MARKER; }
+
+   uint8_t version() const { return get8(offsetof(WireHeaderV2, version)); }
+   uint8_t type() const { return get8(offsetof(WireHeaderV2, type)); }
+   uint16_t flags() const { return be16toh(get<uint16_t>(offsetof(WireHeaderV2, flags))); }
+   uint16_t checksum() const { return be16toh(get<uint16_t>(offsetof(WireHeaderV2, checksum))); }
+   uint16_t marker() const { return be16toh(get<uint16_t>(offsetof(WireHeaderV2, marker))); }
+   uint32_t session_id() const { return be32toh(get<uint32_t>(offsetof(WireHeaderV2, session_id))); }
+   uint16_t payload_len() const { return be16toh(get<uint16_t>(offsetof(WireHeaderV2, payload_len))); }
+   uint64_t offset() const { return be64toh(get<uint64_t>(offsetof(WireHeaderV2, offset))); }
+
+   void set_version() {
+      set8(offsetof(WireHeaderV2, version), WireHeaderV2::VERSION);
+      set<uint16_t>(offsetof(WireHeaderV2, marker), htobe16(WireHeaderV2::MARKER));
+      set<uint16_t>(offsetof(WireHeaderV2, reserved), 0);
+   }
+   void set_type(uint8_t v) { set8(offsetof(WireHeaderV2, type), v); }
+   void set_flags(uint16_t v) { set<uint16_t>(offsetof(WireHeaderV2, flags), htobe16(v)); }
+   void set_checksum(uint16_t v) { set<uint16_t>(offsetof(WireHeaderV2, checksum), htobe16(v)); }
+   void set_session_id(uint32_t v) { set<uint32_t>(offsetof(WireHeaderV2, session_id), htobe32(v)); }
+   void set_payload_len(uint16_t v) { set<uint16_t>(offsetof(WireHeaderV2, payload_len), htobe16(v)); }
+   void set_offset(uint64_t v) { set<uint64_t>(offsetof(WireHeaderV2, offset), htobe64(v)); }
+
+   char *payload() const { return buffer + SIZE; }
+};
+
+/**
+ * Read/write view of a WireCapabilities payload (pass the packet's payload pointer).
+ */
+class WireCapabilitiesView : public WireView {
+public:
+   static const size_t SIZE = sizeof(WireCapabilities);
+
+   explicit WireCapabilitiesView(char *payload) : WireView(payload) {}
+
+   uint32_t recv_buffer() const { return be32toh(get<uint32_t>(offsetof(WireCapabilities, recv_buffer))); }
+   uint16_t max_segment() const { return be16toh(get<uint16_t>(offsetof(WireCapabilities, max_segment))); }
+   uint16_t features() const { return be16toh(get<uint16_t>(offsetof(WireCapabilities, features))); }
+   uint16_t checksum_types() const { return be16toh(get<uint16_t>(offsetof(WireCapabilities, checksum_types))); }
+   uint16_t selected_mss() const { return be16toh(get<uint16_t>(offsetof(WireCapabilities, selected_mss))); }
+
+   void set_recv_buffer(uint32_t v) { set<uint32_t>(offsetof(WireCapabilities, recv_buffer), htobe32(v)); }
+   void set_max_segment(uint16_t v) { set<uint16_t>(offsetof(WireCapabilities, max_segment), htobe16(v)); }
+   void set_features(uint16_t v) { set<uint16_t>(offsetof(WireCapabilities, features), htobe16(v)); }
+   void set_checksum_types(uint16_t v) { set<uint16_t>(offsetof(WireCapabilities, checksum_types), htobe16(v)); }
+   void set_selected_mss(uint16_t v) { set<uint16_t>(offsetof(WireCapabilities, selected_mss), htobe16(v)); }
+};
+
+/**
+ * Read/write view of a WireRelaySetup payload (pass the packet's payload pointer). Host entries are packed at
+ * HOST_SIZE bytes each, directly after the fixed part.
+ */
+class WireRelaySetupView : public WireView {
+public:
+   static const size_t SIZE = sizeof(WireRelaySetup);
+   static const size_t HOST_SIZE = offsetof(WireRelayHost, port) + sizeof(uint16_t);
+
+   explicit WireRelaySetupView(char *payload) : WireView(payload) {}
+
+   uint16_t fanout() const { return be16toh(get<uint16_t>(offsetof(WireRelaySetup, fanout))); }
+   uint16_t count() const { return be16toh(get<uint16_t>(offsetof(WireRelaySetup, count))); }
+   void set_fanout(uint16_t v) { set<uint16_t>(offsetof(WireRelaySetup, fanout), htobe16(v)); }
+   void set_count(uint16_t v) { set<uint16_t>(offsetof(WireRelaySetup, count), htobe16(v)); }
+
+   // Addresses and ports are stored exactly as in a sockaddr_in (already network order)
+   uint32_t host_address(size_t i) const { return get<uint32_t>(host_at(i) + offsetof(WireRelayHost, address)); }
+   uint16_t host_port(size_t i) const { return get<uint16_t>(host_at(i) + offsetof(WireRelayHost, port)); }
+   void set_host(size_t i, uint32_t address, uint16_t port) {
+      set<uint32_t>(host_at(i) + offsetof(WireRelayHost, address), address);
+      set<uint16_t>(host_at(i) + offsetof(WireRelayHost, port), port);
+   }
+
+   static size_t length(size_t count) { return SIZE + count * HOST_SIZE; }
+
+private:
+   static size_t host_at(size_t i) { return SIZE + i * HOST_SIZE; }
+};
+
+/**
+ * Read/write view of a WireCarouselSymbol prefix (pass the packet's payload pointer).
+ */
+class WireCarouselView : public WireView {
+public:
+   static const size_t SIZE = sizeof(WireCarouselSymbol);
+
+   explicit WireCarouselView(char *payload) : WireView(payload) {}
+
+   uint64_t file_size() const { return be64toh(get<uint64_t>(offsetof(WireCarouselSymbol, file_size))); }
+   uint32_t block_bytes() const { return be32toh(get<uint32_t>(offsetof(WireCarouselSymbol, block_bytes))); }
+   uint32_t seed() const { return be32toh(get<uint32_t>(offsetof(WireCarouselSymbol, seed))); }
+
+   void set_file_size(uint64_t v) { set<uint64_t>(offsetof(WireCarouselSymbol, file_size), htobe64(v)); }
+   void set_block_bytes(uint32_t v) { set<uint32_t>(offsetof(WireCarouselSymbol, block_bytes), htobe32(v)); }
+   void set_seed(uint32_t v) { set<uint32_t>(offsetof(WireCarouselSymbol, seed), htobe32(v)); }
+
+   char *symbol() const { return buffer + SIZE; }
+};
+
+#endif /* INCLUDE_MFTPWIRE_H_ */
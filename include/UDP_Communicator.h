@@ -15,6 +15,7 @@
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <unordered_map>
 #include <vector>
 #include <cstring>
 #include <ctime>
@@ -25,19 +26,45 @@
 #include <netinet/in.h>
 #include <netdb.h>
 
+#include "MftpLogger.h"
+#include "MftpProfiler.h"
+#include "MftpTrace.h"
+#include "MftpWire.h"
+#include "MftpTransport.h"
+#include "MftpAckSet.h"
+
+struct HostStats;
+
 class UDP_Communicator {
 protected:
    // Communication Buffers
    static const int MSG_LEN = 1500;
+   static const size_t LEGACY_HEADER_LEN = 8;
    char in_buffer[MSG_LEN], out_buffer[MSG_LEN];
    uint32_t seq_num, ack_num;
 
+   // Wire format of outgoing packets (1 = legacy 8-byte header, 2 = WireHeaderV2) and the v2 session identifier
+   int wire_version = 1;
+   size_t header_len = LEGACY_HEADER_LEN;
+   uint32_t session_id = 0;
+
    // Utility Variables
    std::string log;
    bool debug;
+   MftpLogger &logger = MftpLogger::instance(); // Asynchronous logger for hot-path messages
+   MftpProfiler *profiler = nullptr; // Only allocated in profiling mode
+   MftpTrace *tracer = nullptr; // Only allocated in trace mode
+   MftpTransport *transport = &MftpSocketTransport::instance(); // Sockets and protocol clock (real or simulated)
+
+   // Define user-friendly packet types (SYN and later exist in the v2 wire format only)
+   enum {
+      DATA_PACKET = 1, ACK = 2, FIN = 3, RESET = 4, SYN = 5, SYN_ACK = 6, PROBE = 7, PROBE_ACK = 8, RELAY_SETUP = 9,
+      RELAY_ACK = 10, PEER_SETUP = 11, PEER_ACK = 12, NACK = 13, CAROUSEL = 14
+   };
 
-   // Define user-friendly packet types
-   enum { DATA_PACKET = 1, ACK = 2, FIN = 3, RESET = 4 };
+   // Largest UDP payload that is not fragmented on an Ethernet path, and the smallest any IPv4 path must carry
+   static const size_t ETHERNET_UDP_PAYLOAD = 1472;
+   static const size_t MIN_UDP_PAYLOAD = 548;
 
    // Read Packet headers
    uint32_t decode_seq_num();
@@ -49,20 +76,127 @@ protected:
    void encode_checksum();
    void encode_packet_type(int type);
 
+   // Version 2 headers
+   void encode_v2_header(int type, uint16_t flags, uint64_t offset, uint16_t payload_len);
+   bool valid_v2_checksum(int received_len);
+   static uint16_t v2_checksum(char *buffer);
+
+   // Packet trace
+   bool open_trace(const std::string &path, uint64_t records, MftpTrace::Role role, int port);
+
+/**
+ * Record a packet event in the trace. Call sites cost a single branch when tracing is disabled.
+ * @param event the event
+ * @param peer the remote host
+ * @param seq the sequence number of the packet
+ * @param offset the stream offset of the packet's first byte
+ * @param length the payload bytes
+ * @param detail the cause, drop reason or ACK flags of the event (see MftpTrace)
+ * @param hosts the hosts outstanding, for a TIMEOUT (clamped to 65535)
+ */
+   void trace(MftpTrace::Event event, const sockaddr_in &peer, uint32_t seq, uint64_t offset, size_t length,
+              uint8_t detail = 0, size_t hosts = 0) {
+      if (tracer)
+         tracer->record(event, std::chrono::duration_cast<std::chrono::microseconds>(
+                 transport->now().time_since_epoch()).count(), peer, seq, offset, (uint16_t) length, detail,
+                 (uint16_t) std::min<size_t>(hosts, UINT16_MAX));
+   }
+
 /**
- * Encapsulate contact information, Current Sequence/segment number, and latest ack number, for a remote MultiFTP Host.
+ * One path to a remote host in multipath mode: a socket bound to one local address, with the path quality measured
+ * from the ACKs.
  */
-   struct RemoteHost {
-      explicit RemoteHost(sockaddr_in *addr, int sockfd) {
-         this->address = addr;
+   struct RemotePath {
+      explicit RemotePath(int sockfd, in_addr local) {
          this->sockfd = sockfd;
-         segment_num = 0;
-         ack_num = 0;
+         this->local = local;
+         srtt_us = 0;
+         loss = 0;
+         credit = 0;
+         packets_sent = 0;
+         packets_acked = 0;
       }
 
-      sockaddr_in *address;
       int sockfd;
-      uint32_t segment_num, ack_num; // The latest segment/ack numbers for this client
+      in_addr local;
+      double srtt_us, loss; // Smoothed RTT (0 until measured) and loss rate, both moving averages
+      double credit; // Weighted round-robin credit for scheduling new packets
+      uint64_t packets_sent, packets_acked;
+   };
+
+/**
+ * Encapsulate contact information and protocol state of the remote MultiFTP Hosts of a client, as a structure of
+ * arrays indexed by host: the per-packet loops stream through the few fields they use, and addresses are stored
+ * inline. The hosts that have not acknowledged the packet in flight are the `unacked` set. Hosts share the client's
+ * sockets, so a datagram is matched to its host by source address through `index`.
+ */
+   struct RemoteHosts {
+      std::vector<sockaddr_in> address;
+      std::unordered_map<uint64_t, uint32_t> index; // Host of each address (see key())
+      std::vector<int> sockfd; // The shared socket the host is reached through
+      std::vector<HostStats *> stats; // Live statistics per host (owned by the client's MftpStats)
+      MftpAckSet unacked;
+
+      // Negotiated by the v2 handshake: advertised receive buffer and largest payload, handshake RTT, largest UDP
+      // payload that crossed the path unfragmented, and the features both sides support
+      std::vector<uint32_t> recv_buffer, handshake_rtt_us;
+      std::vector<uint16_t> max_segment, path_payload, features;
+
+      // Multipath: one socket per local address (paths[0] also carries the control packets on sockfd), the path of
+      // the latest transmission, and whether the packet in flight was retransmitted (no RTT sample, after Karn)
+      std::vector<std::vector<RemotePath>> paths;
+      std::vector<uint32_t> path;
+      std::vector<bool> retransmitted;
+
+      // Whether the host's latest ACK reported backpressure: its retransmissions are persist probes, not losses
+      std::vector<bool> stalled;
+
+      size_t size() const { return address.size(); }
+      bool empty() const { return address.empty(); }
+
+      static uint64_t key(const sockaddr_in &addr) { return (uint64_t) addr.sin_addr.s_addr << 16 | addr.sin_port; }
+
+      // The host an address belongs to, or size() if it is not a remote host
+      size_t find(const sockaddr_in &addr) const {
+         std::unordered_map<uint64_t, uint32_t>::const_iterator it = index.find(key(addr));
+         return it == index.end() ? size() : it->second;
+      }
+
+      void add(const sockaddr_in &addr, int socket, HostStats *host_stats) {
+         index[key(addr)] = (uint32_t) size();
+         address.push_back(addr);
+         sockfd.push_back(socket);
+         stats.push_back(host_stats);
+         recv_buffer.push_back(0);
+         handshake_rtt_us.push_back(0);
+         max_segment.push_back(0);
+         path_payload.push_back(0);
+         features.push_back(0);
+         paths.emplace_back();
+         path.push_back(0);
+         retransmitted.push_back(false);
+         stalled.push_back(false);
+         unacked.resize(size());
+      }
+
+      // Keep only the first count hosts
+      void truncate(size_t count) {
+         for (size_t i = count; i < size(); ++i)
+            index.erase(key(address[i]));
+         address.resize(count);
+         sockfd.resize(count);
+         stats.resize(count);
+         recv_buffer.resize(count);
+         handshake_rtt_us.resize(count);
+         max_segment.resize(count);
+         path_payload.resize(count);
+         features.resize(count);
+         paths.resize(count);
+         path.resize(count);
+         retransmitted.resize(count);
+         stalled.resize(count);
+         unacked.resize(count);
+      }
    };
 
 /**
@@ -78,9 +212,15 @@ protected:
    };
 
 public:
+   UDP_Communicator() = default;
    virtual ~UDP_Communicator();
-   int create_bound_UDP_socket(int port);
+   UDP_Communicator(const UDP_Communicator &) = delete; // Owns the profiler and tracer
+   UDP_Communicator &operator=(const UDP_Communicator &) = delete;
+   int create_bound_UDP_socket(int port, bool shared = false);
    int create_unbound_UDP_socket(int port);
+   int create_local_UDP_socket(const in_addr &local);
+   int set_socket_buffer(int sockfd, int optname, int bytes);
+   void enable_profiling();
 
    //Externally-accessible print methods (used in int main()s)
    static void error(std::string input);
@@ -1,7 +1,8 @@
 /**
  * Client.cpp encapsulates the int main() for the MultiFTP Client executable, to handle incoming parameter arguments,
- * reading of a local (binary or text) file, and sending a stream of bytes to rdt_send(). This class also includes an
- * optional argument to repeat the transfer (n) number of times for experimental data gathering.
+ * reading of a local (binary or text) file, or of stdin when the file name is "-", and sending the stream of bytes to
+ * the servers with an MftpAsyncSender. This class also includes an optional argument to repeat the transfer (n)
+ * number of times for experimental data gathering.
  *
  * Created on: June 23th, 2021
  * Author: Stevan Dupor
@@ -9,16 +10,47 @@
  * Unauthorized copying of this file, via any medium is strictly prohibited.
  */
 
+#include <cerrno>
 #include <iostream>
 #include <thread>
 
-#include "MftpClient.h"
+#include "MftpAsync.h"
+#include "MftpOptions.h"
+
+/**
+ * Read the next block of the input. Stdin is read with read(), which returns whatever the pipe holds rather than
+ * waiting for a full block, so that a slow producer's data is sent as it arrives.
+ * @param fd the input file (unused for stdin)
+ * @param from_stdin read stdin instead of the file
+ * @param buffer receives the data
+ * @param len the buffer size
+ * @return the number of bytes read, 0 at the end of the input
+ */
+static size_t read_block(std::ifstream &fd, bool from_stdin, char *buffer, size_t len) {
+   if (!from_stdin) {
+      fd.read(buffer, len);
+      return (size_t) fd.gcount();
+   }
+
+   ssize_t n;
+   do {
+      n = read(STDIN_FILENO, buffer, len);
+   } while (n < 0 && errno == EINTR);
+   if (n < 0)
+      MftpClient::error("Unable to read stdin");
+   return n > 0 ? (size_t) n : 0;
+}
 
 int main(int argc, char *argv[]) {
    std::list<std::string> remotes;
    // Default to one transfer unless we receive instructions to repeat (n) times
    uint8_t repetitions = 1;
 
+   // Consume the optional --switches, wherever they appear
+   MftpOptions options;
+   if (!options.parse(argc, argv))
+      return EXIT_FAILURE;
+
    // Handle commandline arguments format: ./Client server-1 server-2 portnum filename MSS r5
 
    // Pop the 'empty' commandline argument index
@@ -33,7 +65,7 @@ int main(int argc, char *argv[]) {
    // Configure the time log path (Always appends)
    std::string logfile = "Mftp_time_log.csv";
 
-   // Read the Maximum Segment Size argument and pop it
+   // Read the Maximum Segment Size argument ("auto" reads as 0: select from the path MTU) and pop it
    uint16_t max_seg = atoi((const char *) argv[argc]);
    --argc;
 
@@ -51,7 +83,15 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
    }
 
-   // The rest of the arguments are an unknown number of remote server hostnames. Read them all and pop each.
+   // Stdin can only be read once, and a carousel needs the file size up front
+   bool from_stdin = file_name == "-";
+   if (from_stdin && (repetitions > 1 || options.carousel > 0)) {
+      MftpClient::error("Reading stdin (\"-\") cannot be combined with repetitions or --carousel.");
+      return EXIT_FAILURE;
+   }
+
+   // The rest of the arguments are an unknown number of remote server hostnames (optionally "hostname:port"). Read
+   // them all and pop each.
    while (argc > 0) {
       remotes.push_front(std::string(argv[argc]));
       --argc;
@@ -59,18 +99,49 @@ int main(int argc, char *argv[]) {
 
    // Run the transfer (repetitions) times
    for (uint8_t i = 0; i < repetitions; ++i) {
-      char f_in;
-      std::ifstream fd(file_name, std::ios_base::binary);
-      MftpClient client = MftpClient(remotes, logfile, port, false, max_seg);
-
-      // Stream bytes from the input file to rdt_send()
-      while (fd >> std::noskipws >> f_in) {
-         client.rdt_send(f_in);
+      std::ifstream fd;
+      if (!from_stdin)
+         fd.open(file_name, std::ios_base::binary);
+      MftpClient client(remotes, logfile, port, false, max_seg);
+      client.set_wire_version(options.wire_version);
+      client.set_fanout(options.fanout);
+      if (options.peer_repair)
+         client.enable_peer_repair();
+      if (!options.local.empty() && !client.enable_multipath(options.local))
+         return EXIT_FAILURE;
+
+      // The v2 handshake negotiates capabilities, selects the MSS when it was given as "auto", and sets up the relay
+      // tree and repair peers. A relay tree that cannot be set up fails the transfer: part of it would never receive
+      // the file.
+      if ((options.wire_version == 2 || max_seg == 0 || options.fanout > 0 || options.peer_repair) &&
+          options.carousel == 0 && !client.handshake(options.bandwidth_mbps) && client.relays())
+         return EXIT_FAILURE;
+      client.enable_stats(options.stats_path, options.stats_interval_ms);
+      if (options.profile)
+         client.enable_profiling();
+      if (!options.trace_path.empty() && !client.enable_trace(options.trace_path, options.trace_records))
+         return EXIT_FAILURE;
+
+      // Carousel: send the whole file as a paced fountain-coded stream, without feedback
+      if (options.carousel > 0) {
+         fd.seekg(0, std::ios_base::end);
+         uint64_t file_size = fd.tellg();
+         fd.seekg(0);
+         if (!client.send_carousel(fd, file_size, options.carousel, options.bandwidth_mbps,
+                                   options.carousel_rounds))
+            return EXIT_FAILURE;
+      } else {
+         // Stream the input file (or stdin) to the servers from the event loop until every packet is acknowledged
+         MftpReactor reactor;
+         MftpAsyncSender sender(reactor, client);
+         bool started = sender.start([&fd, from_stdin](char *buffer, size_t len) {
+            return read_block(fd, from_stdin, buffer, len);
+         });
+         if (!started)
+            return EXIT_FAILURE;
+         reactor.run();
       }
-
-      // Close file and shutdown
       fd.close();
-      client.shutdown();
 
       //Sleep while server resets so we get an accurate startup synchronization
       std::this_thread::sleep_for(std::chrono::milliseconds(500));
@@ -1,6 +1,7 @@
 /**
  * Server.cpp encapsulates the int main() for the MultiFTP Server executable, to handle incoming parameter arguments,
- * and to instantiate the receiver-component of the SAW protocol,  rdt_receive(). This class also includes an
+ * and to run the receiver-component of the SAW protocol with an MftpAsyncReceiver. The file name "-" streams the
+ * received data to stdout. This class also includes an
  * optional argument to repeat the transfer (n) number of times for experimental data gathering.
  *
  * Created on: June 23th, 2021
@@ -9,14 +10,21 @@
  * Unauthorized copying of this file, via any medium is strictly prohibited.
  */
 
+#include <csignal>
 #include <iostream>
 
-#include "MftpServer.h"
+#include "MftpAsync.h"
+#include "MftpOptions.h"
 
 int main(int argc, char *argv[]) {
    // Default  to one transfer unless we receive an argument configuring repeats
    uint8_t repetitions = 1;
 
+   // Consume the optional --switches, wherever they appear
+   MftpOptions options;
+   if (!options.parse(argc, argv))
+      return EXIT_FAILURE;
+
    // Handle commandline arguments format: ./Server portnum filename loss_probability r5
    // Pop the "blank" argument index
    --argc;
@@ -48,10 +56,35 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
    }
 
+   // Streaming to stdout: keep the console output off the data, and report a closed pipe as a write error
+   if (file_name == "-") {
+      MftpLogger::instance().set_console(std::cerr);
+      signal(SIGPIPE, SIG_IGN);
+   }
+
    // Start the server and repeat the experiment (repetitions) number of times
    for (uint8_t i = 0; i < repetitions; ++i) {
-      MftpServer server = MftpServer(file_name, logfile, port, false, loss_probability);
-      server.rdt_receive();
+      MftpServer server(file_name, logfile, port, false, loss_probability);
+      if (!options.group.empty() && !server.join_group(options.group, port))
+         return EXIT_FAILURE;
+      if (!options.impair.empty() && !server.set_impairments(options.impair))
+         return EXIT_FAILURE;
+      server.enable_stats(options.stats_path, options.stats_interval_ms);
+      if (options.profile)
+         server.enable_profiling();
+      if (!options.trace_path.empty() && !server.enable_trace(options.trace_path, options.trace_records))
+         return EXIT_FAILURE;
+
+      // Receive from the event loop until the client closes the connection
+      MftpReactor reactor;
+      MftpAsyncReceiver receiver(reactor, server);
+      bool written = false;
+      receiver.on_complete([&written](bool success) { written = success; });
+      if (!receiver.start())
+         return EXIT_FAILURE;
+      reactor.run();
+      if (!written)
+         return EXIT_FAILURE;
    }
 
    //Say goodbye and exit.
@@ -0,0 +1,158 @@
+/**
+ * SimNet.cpp encapsulates the int main() for the MultiFTP network simulator: one client sends a generated stream to
+ * any number of servers on an MftpSimNet, all in this process and in virtual time, and the completion time and
+ * traffic are reported. Every host gets the same link model; the run is deterministic for a given seed.
+ *
+ *    ./SimNet servers bytes MSS loss_probability latency_us [bandwidth_mbps] [jitter_us] [seed] [--fanout=<k>]
+ *             [--peer-repair]
+ *
+ * The client runs the v2 handshake on the simulated network, then sends with v2 headers; the servers discard the data.
+ * With --fanout, the servers forward the stream down a relay tree (their relays run on the simulation too), and with
+ * --peer-repair they repair each other's losses.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <arpa/inet.h>
+
+#include "MftpAsync.h"
+#include "MftpOptions.h"
+#include "MftpSimNet.h"
+
+namespace {
+   const int SERVER_PORT = 5000;
+   const uint32_t CLIENT_ADDRESS = 0x0A000001; // 10.0.0.1; the servers follow it
+
+   /**
+    * Format a number with a fixed precision.
+    */
+   std::string fixed(double value, int precision) {
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(precision) << value;
+      return out.str();
+   }
+}
+
+int main(int argc, char *argv[]) {
+   MftpOptions options;
+   if (!options.parse(argc, argv))
+      return EXIT_FAILURE;
+   if (argc < 6 || argc > 9) {
+      UDP_Communicator::error("Usage: ./SimNet servers bytes MSS loss_probability latency_us [bandwidth_mbps] "
+                              "[jitter_us] [seed] [--fanout=<k>] [--peer-repair]");
+      return EXIT_FAILURE;
+   }
+   size_t server_count = strtoul(argv[1], nullptr, 10);
+   uint64_t bytes = strtoull(argv[2], nullptr, 10);
+   uint16_t max_seg = (uint16_t) atoi(argv[3]);
+   MftpLinkModel link;
+   link.loss = atof(argv[4]);
+   link.latency_us = (uint32_t) strtoul(argv[5], nullptr, 10);
+   link.bandwidth_mbps = argc > 6 ? (uint32_t) strtoul(argv[6], nullptr, 10) : 0;
+   link.jitter_us = argc > 7 ? (uint32_t) strtoul(argv[7], nullptr, 10) : 0;
+   uint64_t seed = argc > 8 ? strtoull(argv[8], nullptr, 10) : 1;
+   if (server_count == 0 || max_seg == 0) {
+      UDP_Communicator::error("The number of servers and the MSS must be positive.");
+      return EXIT_FAILURE;
+   }
+
+   // Thousands of servers would each print their report: keep the console for the summary
+   std::ostream &console = MftpLogger::instance().console();
+   std::ostream silent(nullptr);
+   MftpLogger::instance().set_level(MftpLogger::NONE);
+   MftpLogger::instance().set_console(silent);
+
+   MftpSimNet net(seed);
+   in_addr address;
+   address.s_addr = htonl(CLIENT_ADDRESS);
+   MftpTransport &client_host = net.add_host(address, link);
+
+   // The servers, each on its own host, receiving from the event loop
+   std::string output = "/dev/null", no_log;
+   std::vector<sockaddr_in> server_addresses;
+   std::vector<std::unique_ptr<MftpServer>> servers;
+   std::vector<std::unique_ptr<MftpAsyncReceiver>> receivers;
+   size_t completed = 0;
+   for (size_t i = 0; i < server_count; ++i) {
+      sockaddr_in server;
+      bzero(&server, sizeof(server));
+      server.sin_family = AF_INET;
+      server.sin_addr.s_addr = htonl(CLIENT_ADDRESS + 1 + (uint32_t) i);
+      server.sin_port = htons(SERVER_PORT);
+      server_addresses.push_back(server);
+
+      servers.emplace_back(new MftpServer(output, no_log, SERVER_PORT, false, 0,
+                                          net.add_host(server.sin_addr, link)));
+      servers.back()->set_event_loop(&net);
+      receivers.emplace_back(new MftpAsyncReceiver(net, *servers.back()));
+      receivers.back()->on_complete([&completed](bool) { ++completed; });
+      if (!receivers.back()->start())
+         return EXIT_FAILURE;
+   }
+
+   // The client runs the handshake, then sends a generated stream; a relay tree that cannot be set up ends the run
+   MftpClient client(server_addresses, no_log, SERVER_PORT, false, max_seg, client_host);
+   client.set_fanout(options.fanout);
+   if (options.peer_repair)
+      client.enable_peer_repair();
+   MftpAsyncHandshake handshake(net, client);
+   MftpAsyncSender sender(net, client);
+   uint64_t generated = 0;
+   uint64_t handshake_us = 0, finished_us = 0;
+   sender.on_complete([&net, &finished_us](bool) { finished_us = net.now_us(); });
+   handshake.on_complete([&](bool negotiated) {
+      handshake_us = net.now_us();
+      if (!negotiated && client.relays()) {
+         net.stop();
+         return;
+      }
+      bool started = sender.start([&generated, bytes](char *buffer, size_t len) {
+         size_t n = (size_t) std::min<uint64_t>(len, bytes - generated);
+         for (size_t i = 0; i < n; ++i)
+            buffer[i] = (char) (generated + i);
+         generated += n;
+         return (ssize_t) n;
+      });
+      if (!started)
+         net.stop();
+   });
+   if (!handshake.start(options.bandwidth_mbps))
+      return EXIT_FAILURE;
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   net.run();
+   double real_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   double virtual_s = finished_us / 1e6;
+
+   size_t complete_copies = 0;
+   for (const std::unique_ptr<MftpServer> &server : servers) {
+      if (server->bytes_received() == bytes)
+         ++complete_copies;
+   }
+
+   MftpLogger::instance().set_console(console);
+   UDP_Communicator::info("Simulated " + std::to_string(server_count) + " servers, " + std::to_string(bytes) +
+                          " bytes, MSS " + std::to_string(max_seg) + ", loss " + fixed(link.loss, 4) +
+                          ", latency " + std::to_string(link.latency_us) + " us, seed " + std::to_string(seed) +
+                          (options.fanout > 0 ? ", fan-out " + std::to_string(options.fanout) : "") +
+                          (options.peer_repair ? ", peer repair" : ""));
+   UDP_Communicator::info("   Handshake time (s)              : " + fixed(handshake_us / 1e6, 6) +
+                          (client.handshake_result() ? "" : " (failed)"));
+   UDP_Communicator::info("   Sender finished                 : " + std::string(sender.done() ? "yes" : "no"));
+   UDP_Communicator::info("   Servers with the whole stream   : " + std::to_string(complete_copies) + " of " +
+                          std::to_string(server_count) + " (" + std::to_string(completed) + " closed)");
+   UDP_Communicator::info("   Virtual completion time (s)     : " + fixed(virtual_s, 6));
+   UDP_Communicator::info("   Simulation time (s)             : " + fixed(real_s, 3) + " (" +
+                          fixed(real_s > 0 ? virtual_s / real_s : 0, 1) + "x real time)");
+   UDP_Communicator::info("   Datagrams sent / lost / overflow: " + std::to_string(net.datagrams_sent()) + " / " +
+                          std::to_string(net.datagrams_lost()) + " / " + std::to_string(net.datagrams_overflowed()));
+   return complete_copies == server_count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
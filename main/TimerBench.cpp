@@ -0,0 +1,182 @@
+/**
+ * TimerBench.cpp encapsulates the int main() for the timer wheel microbenchmark: millions of retransmission deadlines
+ * are armed, most of them cancelled (their ACK arrived), and the clock is advanced until the rest have expired, once
+ * on MftpTimerWheel and once on the ordered map the event loop kept its timers in before. The cost per operation of
+ * each phase is reported, and the wheel's expirations are checked against the deadlines.
+ *
+ *    ./TimerBench [timers] [cancel_fraction] [seed]
+ *
+ * Deadlines are spread log-uniformly from 50 us to 2 s (from LAN retransmission timeouts to persist probes), and the
+ * clock advances in 100 us steps, the way an event loop reads it once per iteration.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+#include "MftpTimerWheel.h"
+#include "UDP_Communicator.h"
+
+namespace {
+   const double MIN_DELAY_US = 50;
+   const double MAX_DELAY_US = 2000000;
+   const uint64_t STEP_US = 100;
+
+   /**
+    * The time taken by each phase of a run, and the number of timers that expired.
+    */
+   struct Result {
+      double arm_s = 0, cancel_s = 0, advance_s = 0;
+      uint64_t fired = 0, late = 0;
+   };
+
+   /**
+    * Format a number with a fixed precision.
+    */
+   std::string fixed(double value, int precision) {
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(precision) << value;
+      return out.str();
+   }
+
+   /**
+    * Seconds elapsed since a time point.
+    */
+   double since(std::chrono::steady_clock::time_point start) {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   }
+
+   /**
+    * Run the benchmark on the timer wheel. Each timer's payload is its index, so that every expiration can be checked
+    * against its deadline: it must fire in the step that reaches it, not before and not later.
+    */
+   Result run_wheel(const std::vector<uint64_t> &expiry, const std::vector<size_t> &cancelled) {
+      Result result;
+      MftpTimerWheel wheel(0);
+      std::vector<MftpTimerWheel::TimerId> ids(expiry.size());
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < expiry.size(); ++i)
+         ids[i] = wheel.arm(expiry[i], i);
+      result.arm_s = since(start);
+
+      start = std::chrono::steady_clock::now();
+      for (size_t i : cancelled)
+         wheel.cancel(ids[i]);
+      result.cancel_s = since(start);
+
+      std::vector<uint64_t> expired;
+      start = std::chrono::steady_clock::now();
+      for (uint64_t now = STEP_US; !wheel.empty(); now += STEP_US) {
+         expired.clear();
+         wheel.advance(now, expired);
+         result.fired += expired.size();
+         for (uint64_t i : expired) {
+            if (expiry[i] > now || expiry[i] + STEP_US <= now)
+               ++result.late;
+         }
+      }
+      result.advance_s = since(start);
+      return result;
+   }
+
+   /**
+    * Run the benchmark on an ordered map of (deadline, id) with an index from id to deadline for cancel(), as the
+    * event loop kept its timers before the wheel.
+    */
+   Result run_map(const std::vector<uint64_t> &expiry, const std::vector<size_t> &cancelled) {
+      Result result;
+      std::map<std::pair<uint64_t, uint64_t>, uint64_t> timers;
+      std::unordered_map<uint64_t, uint64_t> deadlines;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < expiry.size(); ++i) {
+         timers.emplace(std::make_pair(expiry[i], (uint64_t) i), i);
+         deadlines[i] = expiry[i];
+      }
+      result.arm_s = since(start);
+
+      start = std::chrono::steady_clock::now();
+      for (size_t i : cancelled) {
+         std::unordered_map<uint64_t, uint64_t>::iterator it = deadlines.find(i);
+         timers.erase(std::make_pair(it->second, (uint64_t) i));
+         deadlines.erase(it);
+      }
+      result.cancel_s = since(start);
+
+      std::vector<uint64_t> expired;
+      start = std::chrono::steady_clock::now();
+      for (uint64_t now = STEP_US; !timers.empty(); now += STEP_US) {
+         expired.clear();
+         while (!timers.empty() && timers.begin()->first.first <= now) {
+            expired.push_back(timers.begin()->second);
+            deadlines.erase(timers.begin()->first.second);
+            timers.erase(timers.begin());
+         }
+         result.fired += expired.size();
+      }
+      result.advance_s = since(start);
+      return result;
+   }
+
+   /**
+    * Print one run.
+    */
+   void report(const std::string &name, const Result &result, size_t timers, size_t cancelled) {
+      UDP_Communicator::info(name);
+      UDP_Communicator::info("   Arm     (ns/timer)              : " + fixed(result.arm_s * 1e9 / timers, 1));
+      UDP_Communicator::info("   Cancel  (ns/timer)              : " +
+                             fixed(cancelled ? result.cancel_s * 1e9 / cancelled : 0, 1));
+      UDP_Communicator::info("   Advance (ns/expired timer)      : " +
+                             fixed(result.fired ? result.advance_s * 1e9 / result.fired : 0, 1) + " (" +
+                             std::to_string(result.fired) + " expired)");
+      UDP_Communicator::info("   Total   (s)                     : " +
+                             fixed(result.arm_s + result.cancel_s + result.advance_s, 3));
+   }
+}
+
+int main(int argc, char *argv[]) {
+   if (argc > 4) {
+      UDP_Communicator::error("Usage: ./TimerBench [timers] [cancel_fraction] [seed]");
+      return EXIT_FAILURE;
+   }
+   size_t timers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000000;
+   double cancel_fraction = argc > 2 ? atof(argv[2]) : 0.9;
+   uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+
+   // The deadlines, and the timers whose ACK arrives in time, in random order
+   std::mt19937_64 random(seed);
+   std::uniform_real_distribution<double> exponent(std::log(MIN_DELAY_US), std::log(MAX_DELAY_US));
+   std::vector<uint64_t> expiry(timers);
+   for (uint64_t &e : expiry)
+      e = (uint64_t) std::exp(exponent(random));
+   std::vector<size_t> cancelled;
+   std::bernoulli_distribution acked(std::min(std::max(cancel_fraction, 0.0), 1.0));
+   for (size_t i = 0; i < timers; ++i) {
+      if (acked(random))
+         cancelled.push_back(i);
+   }
+   std::shuffle(cancelled.begin(), cancelled.end(), random);
+
+   UDP_Communicator::info(std::to_string(timers) + " timers, " + std::to_string(cancelled.size()) +
+                          " cancelled, deadlines 50 us to 2 s, clock steps of " + std::to_string(STEP_US) + " us");
+   Result wheel = run_wheel(expiry, cancelled);
+   report("MftpTimerWheel", wheel, timers, cancelled.size());
+   Result map = run_map(expiry, cancelled);
+   report("Ordered map", map, timers, cancelled.size());
+
+   if (wheel.fired != timers - cancelled.size() || wheel.late > 0) {
+      UDP_Communicator::error("Timer wheel: " + std::to_string(wheel.fired) + " expired, " +
+                              std::to_string(wheel.late) + " outside their step");
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,350 @@
+/**
+ * TraceReplay.cpp encapsulates the int main() for the packet trace analyzer: it reads the binary traces written with
+ * --trace by a client and any of its servers, aligns them on the wall clock, and exports CSV files for plotting.
+ *
+ *    ./TraceReplay output_prefix interval_ms trace [[address:port=]trace ...]
+ *
+ *    <output_prefix>timeline.csv        Every event, per host in time order
+ *    <output_prefix>goodput.csv         Bytes acknowledged by each host (and by every host) per interval, and Mbit/s
+ *    <output_prefix>retransmissions.csv Every retransmission, with its cause
+ *    <output_prefix>causes.csv          The number of retransmissions per host and cause
+ *
+ * A server trace is matched to the client's host of the same port if there is only one; otherwise give the host it
+ * is for, as the client addressed it (eg 192.168.1.32:7735=server32.trace). The cause of a retransmission comes from
+ * the matched server's events for that packet since the previous transmission: the data had not arrived
+ * (data_lost_or_late), was dropped by the loss model (loss_model) or for its checksum (corrupted), could not be queued
+ * (receiver_stall), or was received and ACKed but the ACK did not arrive in time (ack_lost_or_late). Probes of a
+ * stalled server are persist_probe, and timeouts of a host without a server trace are timeout.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+
+#include "UDP_Communicator.h"
+
+namespace {
+   /**
+    * A trace file, and the host its events are reported under (for a server trace: the server).
+    */
+   struct Trace {
+      std::string path, host;
+      MftpTrace::Header header;
+      std::vector<MftpTrace::Record> records;
+   };
+
+   /**
+    * An event of any trace, on the wall clock.
+    */
+   struct Event {
+      int64_t time_us;
+      std::string host;
+      bool server;
+      const MftpTrace::Record *record;
+   };
+
+   /**
+    * Format a number with a fixed precision.
+    */
+   std::string fixed(double value, int precision) {
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(precision) << value;
+      return out.str();
+   }
+
+   /**
+    * Format the remote host of a record as "address:port".
+    */
+   std::string host_name(const MftpTrace::Record &record) {
+      char text[INET_ADDRSTRLEN];
+      in_addr address;
+      address.s_addr = record.address;
+      inet_ntop(AF_INET, &address, text, sizeof(text));
+      return std::string(text) + ":" + std::to_string(ntohs(record.port));
+   }
+
+   /**
+    * The meaning of a record's detail field, for its event (for a TIMEOUT, the hosts still outstanding).
+    */
+   std::string detail_name(const MftpTrace::Record &record) {
+      switch (record.event) {
+         case MftpTrace::RETRANSMIT:
+            return record.detail == MftpTrace::BY_PERSIST ? "persist" : "timeout";
+         case MftpTrace::TIMEOUT:
+            return std::to_string(record.hosts) + " outstanding";
+         case MftpTrace::DROP:
+            return record.detail == MftpTrace::LOSS ? "loss" : record.detail == MftpTrace::CHECKSUM ? "checksum" :
+                                                                "backpressure";
+         default:
+            if ((record.detail & MftpTrace::REPAIRED) && (record.detail & MftpTrace::HELD))
+               return "repaired|held";
+            return record.detail & MftpTrace::REPAIRED ? "repaired" : record.detail & MftpTrace::HELD ? "held" : "";
+      }
+   }
+
+   /**
+    * The cause of a retransmission, from the server's events for the packet since its previous transmission.
+    * @param server the server's events for the packet, in time order (nullptr if the host has no server trace)
+    * @param since the previous transmission of the packet
+    * @param until the retransmission
+    */
+   std::string retransmission_cause(const std::vector<Event> *server, int64_t since, int64_t until) {
+      if (!server)
+         return "timeout";
+      const Event *last = nullptr;
+      for (const Event &event : *server) {
+         if (event.time_us >= since && event.time_us < until)
+            last = &event;
+      }
+      if (!last)
+         return "data_lost_or_late";
+      if (last->record->event != MftpTrace::DROP)
+         return "ack_lost_or_late";
+      return last->record->detail == MftpTrace::LOSS ? "loss_model" :
+             last->record->detail == MftpTrace::CHECKSUM ? "corrupted" : "receiver_stall";
+   }
+
+   /**
+    * Open an output file, reporting failure.
+    */
+   bool create(std::ofstream &out, const std::string &path) {
+      out.open(path);
+      if (!out)
+         UDP_Communicator::error("Could not create " + path);
+      return (bool) out;
+   }
+}
+
+int main(int argc, char *argv[]) {
+   if (argc < 4) {
+      UDP_Communicator::error("Usage: ./TraceReplay output_prefix interval_ms trace [[address:port=]trace ...]");
+      return EXIT_FAILURE;
+   }
+   std::string prefix = argv[1];
+   int64_t interval_us = (int64_t) strtoll(argv[2], nullptr, 10) * 1000;
+   if (interval_us <= 0) {
+      UDP_Communicator::error("The interval must be positive.");
+      return EXIT_FAILURE;
+   }
+
+   // Read the traces
+   std::vector<Trace> traces;
+   for (int i = 3; i < argc; ++i) {
+      std::string arg = argv[i];
+      size_t eq = arg.find('=');
+      traces.emplace_back();
+      Trace &trace = traces.back();
+      trace.path = eq == std::string::npos ? arg : arg.substr(eq + 1);
+      trace.host = eq == std::string::npos ? "" : arg.substr(0, eq);
+      std::string problem;
+      if (!MftpTrace::read(trace.path, trace.header, trace.records, problem)) {
+         UDP_Communicator::error(trace.path + ": " + problem);
+         return EXIT_FAILURE;
+      }
+      UDP_Communicator::info(trace.path + ": " + (trace.header.role == MftpTrace::SERVER ? "server" : "client") +
+                             " (pid " + std::to_string(trace.header.pid) + "), " +
+                             std::to_string(trace.records.size()) + " records");
+      if (trace.header.written > trace.records.size())
+         UDP_Communicator::warning("   The ring wrapped: the first " +
+                                   std::to_string(trace.header.written - trace.records.size()) +
+                                   " records were overwritten");
+   }
+
+   // The client's hosts, and the server traces that belong to them
+   std::set<std::string> client_hosts;
+   for (const Trace &trace : traces) {
+      if (trace.header.role != MftpTrace::CLIENT)
+         continue;
+      for (const MftpTrace::Record &record : trace.records) {
+         if (record.event == MftpTrace::SEND)
+            client_hosts.insert(host_name(record));
+      }
+   }
+   for (Trace &trace : traces) {
+      if (trace.header.role != MftpTrace::SERVER || !trace.host.empty())
+         continue;
+      std::string suffix = ":" + std::to_string(trace.header.port);
+      size_t matches = 0;
+      for (const std::string &host : client_hosts) {
+         if (host.size() > suffix.size() && host.compare(host.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            trace.host = host;
+            ++matches;
+         }
+      }
+      if (matches != 1) {
+         trace.host = trace.path;
+         if (!client_hosts.empty())
+            UDP_Communicator::warning(trace.path + ": no single client host on port " +
+                                      std::to_string(trace.header.port) + ", give it as address:port=" + trace.path);
+      }
+   }
+
+   // Traces of one boot of one host share the monotonic clock, which aligns them exactly; the wall clock offsets
+   // are only used for traces from several hosts (and are as good as their clock synchronization)
+   bool same_boot = true;
+   for (const Trace &trace : traces)
+      same_boot = same_boot && trace.header.boot_id != 0 && trace.header.boot_id == traces[0].header.boot_id;
+   if (!same_boot)
+      UDP_Communicator::warning("The traces come from several hosts (or boots): aligned on their wall clocks");
+
+   // Every event on the wall clock, per host in time order (records of one trace keep their order)
+   std::vector<Event> events;
+   for (const Trace &trace : traces) {
+      bool server = trace.header.role == MftpTrace::SERVER;
+      int64_t offset_us = same_boot ? traces[0].header.clock_offset_us : trace.header.clock_offset_us;
+      for (const MftpTrace::Record &record : trace.records) {
+         std::string host = server ? trace.host : record.event == MftpTrace::TIMEOUT ? "*" : host_name(record);
+         events.push_back(Event{(int64_t) record.time_us + offset_us, host, server, &record});
+      }
+   }
+   if (events.empty()) {
+      UDP_Communicator::warning("The traces hold no events.");
+      return EXIT_SUCCESS;
+   }
+   std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+      return a.host != b.host ? a.host < b.host : a.time_us < b.time_us;
+   });
+   int64_t start_us = std::min_element(events.begin(), events.end(), [](const Event &a, const Event &b) {
+      return a.time_us < b.time_us;
+   })->time_us;
+
+   std::ofstream timeline;
+   if (!create(timeline, prefix + "timeline.csv"))
+      return EXIT_FAILURE;
+   timeline << "host,time_s,side,event,seq,offset,length,detail,peer\n";
+   for (const Event &event : events) {
+      const MftpTrace::Record &r = *event.record;
+      timeline << event.host << ',' << fixed((event.time_us - start_us) / 1e6, 6) << ','
+               << (event.server ? "server" : "client") << ',' << MftpTrace::event_name(r.event) << ',' << r.seq
+               << ',' << r.offset << ',' << r.length << ',' << detail_name(r) << ','
+               << (r.event == MftpTrace::TIMEOUT ? "" : host_name(r)) << '\n';
+   }
+
+   // Goodput: the bytes each host acknowledged (or, without a client trace, received) per interval, and the bytes of
+   // the packets every host has acknowledged
+   std::map<std::string, std::vector<uint64_t>> host_bytes;
+   std::set<std::string> acked_hosts;
+   std::vector<uint64_t> all_bytes;
+   std::unordered_map<uint64_t, size_t> acks_per_packet;
+   int64_t intervals = 0;
+   for (const Event &event : events)
+      intervals = std::max(intervals, (event.time_us - start_us) / interval_us + 1);
+   all_bytes.assign(intervals, 0);
+   for (const Event &event : events) {
+      if (!event.server && event.record->event == MftpTrace::ACK_RECEIVED)
+         acked_hosts.insert(event.host);
+   }
+   for (const Event &event : events) {
+      const MftpTrace::Record &r = *event.record;
+      bool acked = !event.server && r.event == MftpTrace::ACK_RECEIVED;
+      bool received = event.server && r.event == MftpTrace::RECEIVE && !acked_hosts.count(event.host);
+      if (!acked && !received)
+         continue;
+      std::vector<uint64_t> &bins = host_bytes[event.host];
+      bins.resize(intervals, 0);
+      bins[(event.time_us - start_us) / interval_us] += r.length;
+   }
+
+   // A packet is delivered when the last host acknowledges it, in time order over all hosts
+   std::vector<const Event *> acks;
+   for (const Event &event : events) {
+      if (!event.server && event.record->event == MftpTrace::ACK_RECEIVED)
+         acks.push_back(&event);
+   }
+   std::stable_sort(acks.begin(), acks.end(), [](const Event *a, const Event *b) { return a->time_us < b->time_us; });
+   for (const Event *event : acks) {
+      uint64_t packet = (uint64_t) event->record->seq << 32 ^ event->record->offset;
+      if (++acks_per_packet[packet] == client_hosts.size())
+         all_bytes[(event->time_us - start_us) / interval_us] += event->record->length;
+   }
+
+   std::ofstream goodput;
+   if (!create(goodput, prefix + "goodput.csv"))
+      return EXIT_FAILURE;
+   goodput << "time_s,host,bytes,mbps\n";
+   for (int64_t i = 0; i < intervals; ++i) {
+      std::string time = fixed(i * interval_us / 1e6, 6);
+      if (!acks.empty())
+         goodput << time << ",all," << all_bytes[i] << ',' << fixed(all_bytes[i] * 8.0 / interval_us, 3) << '\n';
+      for (const std::pair<const std::string, std::vector<uint64_t>> &host : host_bytes)
+         goodput << time << ',' << host.first << ',' << host.second[i] << ','
+                 << fixed(host.second[i] * 8.0 / interval_us, 3) << '\n';
+   }
+
+   // Retransmission causes: the server's arrivals and drops of each packet, per host
+   std::unordered_map<std::string, std::unordered_map<uint32_t, std::vector<Event>>> server_packets;
+   for (const Event &event : events) {
+      uint8_t type = event.record->event;
+      if (event.server && (type == MftpTrace::RECEIVE || type == MftpTrace::DUPLICATE || type == MftpTrace::DROP))
+         server_packets[event.host][event.record->seq].push_back(event);
+   }
+
+   std::ofstream retransmissions;
+   if (!create(retransmissions, prefix + "retransmissions.csv"))
+      return EXIT_FAILURE;
+   retransmissions << "time_s,host,seq,offset,attempt,cause\n";
+   std::map<std::pair<std::string, std::string>, uint64_t> causes;
+   std::map<std::string, uint64_t> totals;
+   std::string host;
+   uint32_t seq = 0;
+   int64_t last_sent = INT64_MIN;
+   uint32_t attempt = 0;
+   for (const Event &event : events) {
+      const MftpTrace::Record &r = *event.record;
+      if (event.server || (r.event != MftpTrace::SEND && r.event != MftpTrace::RETRANSMIT))
+         continue;
+
+      // Events are grouped by host: follow the transmissions of each host's packet in flight
+      if (event.host != host || r.seq != seq) {
+         host = event.host;
+         seq = r.seq;
+         last_sent = INT64_MIN;
+         attempt = 0;
+      }
+      if (r.event == MftpTrace::RETRANSMIT) {
+         ++attempt;
+         std::string cause = "persist_probe";
+         if (r.detail != MftpTrace::BY_PERSIST) {
+            const std::vector<Event> *server = nullptr;
+            std::unordered_map<std::string, std::unordered_map<uint32_t, std::vector<Event>>>::const_iterator
+                    found = server_packets.find(host);
+            if (found != server_packets.end()) {
+               std::unordered_map<uint32_t, std::vector<Event>>::const_iterator packet = found->second.find(seq);
+               static const std::vector<Event> nothing;
+               server = packet != found->second.end() ? &packet->second : &nothing;
+            }
+            cause = retransmission_cause(server, last_sent, event.time_us);
+         }
+         retransmissions << fixed((event.time_us - start_us) / 1e6, 6) << ',' << host << ',' << r.seq << ','
+                         << r.offset << ',' << attempt << ',' << cause << '\n';
+         ++causes[std::make_pair(host, cause)];
+         ++totals[cause];
+      }
+      last_sent = event.time_us;
+   }
+
+   std::ofstream cause_counts;
+   if (!create(cause_counts, prefix + "causes.csv"))
+      return EXIT_FAILURE;
+   cause_counts << "host,cause,count\n";
+   for (const std::pair<const std::pair<std::string, std::string>, uint64_t> &count : causes)
+      cause_counts << count.first.first << ',' << count.first.second << ',' << count.second << '\n';
+
+   UDP_Communicator::info("Events: " + std::to_string(events.size()) + " over " +
+                          fixed(intervals * interval_us / 1e6, 3) + " s, " +
+                          std::to_string(client_hosts.size()) + " client hosts");
+   for (const std::pair<const std::string, uint64_t> &total : totals)
+      UDP_Communicator::info("   Retransmissions (" + total.first + "): " + std::to_string(total.second));
+   UDP_Communicator::info("Wrote " + prefix + "timeline.csv, goodput.csv, retransmissions.csv and causes.csv");
+   return EXIT_SUCCESS;
+}
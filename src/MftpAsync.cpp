@@ -0,0 +1,284 @@
+/**
+ * MftpAsync.cpp implements the non-blocking transfer API: the sender and receiver state machines that drive an
+ * MftpClient or MftpServer from an event loop.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include "MftpAsync.h"
+
+/**
+ * Create a handshake for a configured client.
+ * @param reactor the event loop that will drive the handshake
+ * @param client the client, connected to its servers (must outlive the handshake)
+ */
+MftpAsyncHandshake::MftpAsyncHandshake(MftpEventLoop &reactor, MftpClient &client)
+        : reactor(reactor), client(client), started(false), finished(false), timer(0) {
+}
+
+/**
+ * Destructor -- abandons an unfinished handshake.
+ */
+MftpAsyncHandshake::~MftpAsyncHandshake() {
+   if (started && !finished) {
+      reactor.cancel(timer);
+      for (int fd : client.sockets())
+         reactor.unwatch(fd);
+   }
+}
+
+/**
+ * Start the handshake. The SYN is sent before returning; the rest of the handshake runs on the event loop.
+ * @param bandwidth_mbps expected path bandwidth in Mbit/s, used to size the socket buffers
+ * @return false if the handshake was already started or a socket could not be watched
+ */
+bool MftpAsyncHandshake::start(uint32_t bandwidth_mbps) {
+   if (started)
+      return false;
+   started = true;
+
+   for (int fd : client.sockets()) {
+      if (!reactor.watch(fd, std::bind(&MftpAsyncHandshake::poll, this)))
+         return false;
+   }
+   client.begin_handshake(bandwidth_mbps);
+   poll();
+   return true;
+}
+
+/**
+ * A reply has arrived, or the wait for replies expired: run the next step of the handshake and re-arm the timer, or
+ * report the result once the handshake has ended.
+ */
+void MftpAsyncHandshake::poll() {
+   reactor.cancel(timer);
+   timer = 0;
+   if (!client.poll_handshake(MSG_DONTWAIT)) {
+      timer = reactor.schedule(client.handshake_in_us(), std::bind(&MftpAsyncHandshake::poll, this));
+      return;
+   }
+
+   for (int fd : client.sockets())
+      reactor.unwatch(fd);
+   finished = true;
+   if (completion)
+      completion(client.handshake_result());
+}
+
+/**
+ * Create a sender for a configured client.
+ * @param reactor the event loop that will drive the transfer
+ * @param client the client, connected to its servers (must outlive the sender)
+ */
+MftpAsyncSender::MftpAsyncSender(MftpEventLoop &reactor, MftpClient &client)
+        : reactor(reactor), client(client), block(SOURCE_BLOCK), block_pos(0), block_len(0), started(false),
+          end_of_input(false), in_flight(false), finished(false), waiting(false), timer(0) {
+}
+
+/**
+ * Destructor -- abandons an unfinished transfer (the servers are not told).
+ */
+MftpAsyncSender::~MftpAsyncSender() {
+   if (started && !finished) {
+      reactor.cancel(timer);
+      for (int fd : client.sockets())
+         reactor.unwatch(fd);
+   }
+}
+
+/**
+ * Start sending. The first packet is transmitted before returning; the rest of the transfer runs on the event loop.
+ * @param source the byte stream to send
+ * @return false if the transfer was already started or a socket could not be watched
+ */
+bool MftpAsyncSender::start(Source source) {
+   if (started)
+      return false;
+   started = true;
+   this->source = source;
+
+   for (int fd : client.sockets()) {
+      if (!reactor.watch(fd, std::bind(&MftpAsyncSender::on_readable, this)))
+         return false;
+   }
+   pump();
+   return true;
+}
+
+/**
+ * Start sending the contents of a stream.
+ * @param in the stream (must outlive the transfer)
+ * @return false if the transfer was already started or a socket could not be watched
+ */
+bool MftpAsyncSender::start(std::istream &in) {
+   return start([&in](char *buffer, size_t len) {
+      in.read(buffer, len);
+      return (ssize_t) in.gcount();
+   });
+}
+
+/**
+ * The source has data again after it returned -1 (or has ended): go on sending.
+ */
+void MftpAsyncSender::resume() {
+   if (waiting) {
+      waiting = false;
+      pump();
+   }
+}
+
+/**
+ * Fill the output buffer from the source and transmit the next packet; once the source is exhausted and every packet
+ * is acknowledged, close the connections. Stops early if the source has no data yet.
+ */
+void MftpAsyncSender::pump() {
+   while (!in_flight) {
+      if (block_pos == block_len && !end_of_input) {
+         ssize_t n = source(block.data(), block.size());
+         if (n < 0) {
+            waiting = true;
+            return;
+         }
+         block_len = n;
+         block_pos = 0;
+         end_of_input = block_len == 0;
+      }
+      block_pos += client.fill(block.data() + block_pos, block_len - block_pos);
+
+      if (client.begin_packet(end_of_input)) {
+         in_flight = true;
+         timer = reactor.schedule(client.retransmit_in_us(), std::bind(&MftpAsyncSender::on_timer, this));
+      } else if (end_of_input) {
+         finish();
+         return;
+      }
+   }
+}
+
+/**
+ * The packet in flight is acknowledged by every server: report progress and send the next one.
+ */
+void MftpAsyncSender::acknowledged() {
+   in_flight = false;
+   if (progress)
+      progress(client.bytes_sent());
+   pump();
+}
+
+/**
+ * An ACK (or another reply) has arrived on one of the client sockets.
+ */
+void MftpAsyncSender::on_readable() {
+   if (in_flight && client.poll_acks()) {
+      reactor.cancel(timer);
+      acknowledged();
+   }
+}
+
+/**
+ * The retransmission timer expired: retransmit to the servers that have not acknowledged, and re-arm.
+ */
+void MftpAsyncSender::on_timer() {
+   if (client.poll_acks())
+      acknowledged();
+   else
+      timer = reactor.schedule(client.retransmit_in_us(), std::bind(&MftpAsyncSender::on_timer, this));
+}
+
+/**
+ * Every packet is acknowledged: close the connections and report completion.
+ */
+void MftpAsyncSender::finish() {
+   for (int fd : client.sockets())
+      reactor.unwatch(fd);
+   client.finish();
+   finished = true;
+   if (completion)
+      completion(true);
+}
+
+/**
+ * Create a receiver for a configured server.
+ * @param reactor the event loop that will drive the transfer
+ * @param server the server, bound to its port (must outlive the receiver)
+ */
+MftpAsyncReceiver::MftpAsyncReceiver(MftpEventLoop &reactor, MftpServer &server)
+        : reactor(reactor), server(server), started(false), finished(false), draining(false), timer(0) {
+}
+
+/**
+ * Destructor -- abandons an unfinished transfer.
+ */
+MftpAsyncReceiver::~MftpAsyncReceiver() {
+   if (started && !finished) {
+      reactor.unwatch(server.socket());
+      reactor.cancel(timer);
+   }
+   if (draining && !finished)
+      server.drain_relay(nullptr);
+}
+
+/**
+ * Start receiving: open the output and wait for the client's packets on the event loop.
+ * @return false if the transfer was already started or the socket could not be watched
+ */
+bool MftpAsyncReceiver::start() {
+   if (started)
+      return false;
+   started = true;
+   server.begin_receive();
+   return reactor.watch(server.socket(), std::bind(&MftpAsyncReceiver::on_readable, this));
+}
+
+/**
+ * A packet has arrived: handle it, and close the transfer once it has ended.
+ */
+void MftpAsyncReceiver::on_readable() {
+   uint64_t received = server.bytes_received();
+   handled(server.receive_packet(MSG_DONTWAIT), received);
+}
+
+/**
+ * A timer of the server is due (held-back packets, or the repair timer): run it.
+ */
+void MftpAsyncReceiver::on_timer() {
+   timer = 0;
+   uint64_t received = server.bytes_received();
+   handled(server.run_timers(), received);
+}
+
+/**
+ * Report progress and re-arm the server's timer after packets were handled, or close the transfer
+ * once it has ended (and its relay on the event loop, if any, has forwarded the stream).
+ * @param more false if the transfer has ended
+ * @param received the bytes received before the packets were handled
+ */
+void MftpAsyncReceiver::handled(bool more, uint64_t received) {
+   reactor.cancel(timer);
+   timer = 0;
+   if (more) {
+      if (progress && server.bytes_received() != received)
+         progress(server.bytes_received());
+      if (server.timer_pending())
+         timer = reactor.schedule(server.timer_in_us(), std::bind(&MftpAsyncReceiver::on_timer, this));
+      return;
+   }
+
+   reactor.unwatch(server.socket());
+   draining = server.drain_relay(std::bind(&MftpAsyncReceiver::end, this));
+   if (!draining)
+      end();
+}
+
+/**
+ * Close the transfer and report completion.
+ */
+void MftpAsyncReceiver::end() {
+   bool success = server.end_receive();
+   finished = true;
+   if (completion)
+      completion(success);
+}
@@ -0,0 +1,104 @@
+/**
+ * MftpChunkQueue.cpp implements the bounded hand-off between a receiving thread and a draining thread (relay
+ * forwarding, streaming to stdout), or a consumer on an event loop.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "MftpChunkQueue.h"
+
+/**
+ * Create an empty queue.
+ * @param capacity_bytes the most bytes held at once
+ */
+MftpChunkQueue::MftpChunkQueue(size_t capacity_bytes) : queued_bytes(0), capacity(capacity_bytes), closed(false) {
+}
+
+/**
+ * Test whether a chunk would be accepted. Only the consumer removes chunks, so the answer holds for the producer's
+ * next offer().
+ * @param len the chunk length
+ * @return true if offer() will accept the chunk
+ */
+bool MftpChunkQueue::accepts(size_t len) {
+   std::lock_guard<std::mutex> lock(queue_mutex);
+   return has_room(len);
+}
+
+/**
+ * Queue a copy of a chunk.
+ * @param data the chunk
+ * @param len the chunk length
+ * @return false if the queue is full; the caller must not acknowledge the data
+ */
+bool MftpChunkQueue::offer(const char *data, size_t len) {
+   std::lock_guard<std::mutex> lock(queue_mutex);
+   if (!has_room(len))
+      return false;
+   queue.emplace_back(data, len);
+   queued_bytes += len;
+   queue_ready.notify_one();
+   return true;
+}
+
+/**
+ * Take every queued chunk, waiting for at least one.
+ * @param chunks receives the chunks in order (previous contents are discarded)
+ * @return false once the queue is closed and empty
+ */
+bool MftpChunkQueue::take_all(std::vector<std::string> &chunks) {
+   chunks.clear();
+   std::unique_lock<std::mutex> lock(queue_mutex);
+   queue_ready.wait(lock, [this] { return !queue.empty() || closed; });
+   if (queue.empty())
+      return false;
+
+   while (!queue.empty()) {
+      chunks.emplace_back();
+      chunks.back().swap(queue.front());
+      queue.pop_front();
+   }
+   queued_bytes = 0;
+   return true;
+}
+
+/**
+ * Copy queued bytes without waiting, for a consumer on an event loop. A chunk that does not fit is split.
+ * @param buffer receives the bytes, in order
+ * @param len the buffer length
+ * @return the bytes copied; 0 once the queue is closed and empty, -1 if it is empty but still open
+ */
+ssize_t MftpChunkQueue::read(char *buffer, size_t len) {
+   std::lock_guard<std::mutex> lock(queue_mutex);
+   if (queue.empty())
+      return closed ? 0 : -1;
+
+   size_t copied = 0;
+   while (!queue.empty() && copied < len) {
+      std::string &chunk = queue.front();
+      size_t n = std::min(len - copied, chunk.size());
+      memcpy(buffer + copied, chunk.data(), n);
+      copied += n;
+      if (n == chunk.size())
+         queue.pop_front();
+      else
+         chunk.erase(0, n);
+   }
+   queued_bytes -= copied;
+   return copied;
+}
+
+/**
+ * Signal the end of the stream; take_all() returns false once the remaining chunks are taken.
+ */
+void MftpChunkQueue::close() {
+   std::lock_guard<std::mutex> lock(queue_mutex);
+   closed = true;
+   queue_ready.notify_all();
+}
@@ -12,20 +12,92 @@
  */
 #include "UDP_Communicator.h"
 #include "MftpClient.h"
+#include "MftpFountain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <thread>
+
+#include <arpa/inet.h>
+
+namespace {
+   // Multipath: moving-average gains of the per-path RTT and loss estimates, and the loss rate a path is capped at
+   // (so that a bad path keeps a small share and its estimate recovers)
+   const double PATH_RTT_GAIN = 0.125;
+   const double PATH_LOSS_GAIN = 0.1;
+   const double MAX_PATH_LOSS = 0.9;
+}
 
 /**
  * System constructor to initialize the client.
  *
- * @param remote_server_list a list of string hostnames of remote servers
+ * @param remote_server_list a list of remote server hostnames, each optionally followed by ":port"
  * @param logfile the CSV file that distribution time points are appended to
- * @param port the port to contact remote servers on
+ * @param port the port to contact remote servers on, unless a hostname gives its own
  * @param verbose a flag permitting more terminal output
  * @param max_seg_size the maximum packet payload size in bytes
  */
 MftpClient::MftpClient(std::list<std::string> &remote_server_list, std::string &logfile, int port, bool verbose,
-                       uint16_t max_seg_size) {
+                       uint16_t max_seg_size) : stats("client") {
+   initialize(logfile, port, verbose, max_seg_size);
+
+   // Resolve every name in parallel, then setup each remote server structure in the order given
+   std::vector<std::string> specs(remote_server_list.begin(), remote_server_list.end());
+   std::vector<sockaddr_in> addresses;
+   std::vector<bool> resolved = resolve_hosts(specs, port, addresses);
+   resolve_us = std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now() - startup_start).count();
+   for (size_t i = 0; i < specs.size(); ++i) {
+      if (resolved[i])
+         add_remote_host(addresses[i], specs[i]);
+      else
+         error("Unable to resolve host: " + specs[i]);
+   }
+   open_shared_sockets();
+
+   // Log the start time of the transmission
+   local_time_logs.emplace_back(LogItem());
+   packetize_start = local_time_logs.back().time;
+}
+
+/**
+ * Constructor for a client that sends to already resolved addresses, used by servers relaying to their subtree and by
+ * simulations.
+ *
+ * @param server_addresses the remote servers
+ * @param logfile the CSV file that distribution time points are appended to (empty: no CSV log)
+ * @param port the local port reported for the outgoing sockets
+ * @param verbose a flag permitting more terminal output
+ * @param max_seg_size the maximum packet payload size in bytes (0: select from the path MTU in the handshake)
+ * @param transport the network to send on (the real network, or a simulated host of MftpSimNet)
+ */
+MftpClient::MftpClient(const std::vector<sockaddr_in> &server_addresses, std::string &logfile, int port,
+                       bool verbose, uint16_t max_seg_size, MftpTransport &transport) : stats("relay") {
+   this->transport = &transport;
+   initialize(logfile, port, verbose, max_seg_size);
+
+   for (const sockaddr_in &address : server_addresses)
+      add_remote_host(address, std::string(inet_ntoa(address.sin_addr)) + ":" +
+                               std::to_string(ntohs(address.sin_port)));
+   open_shared_sockets();
+
+   local_time_logs.emplace_back(LogItem());
+   packetize_start = local_time_logs.back().time;
+}
+
+/**
+ * Initialize the protocol state, timers and counters shared by both constructors.
+ */
+void MftpClient::initialize(std::string &logfile, int port, bool verbose, uint16_t max_seg_size) {
+   startup_start = std::chrono::steady_clock::now();
+   resolve_us = 0;
+   first_packet_us = 0;
    log = logfile;
    debug = verbose;
+   if (debug)
+      logger.set_level(MftpLogger::VERBOSE);
 
    // Communication protocol initialization
    system_port = port;
@@ -33,77 +105,822 @@ MftpClient::MftpClient(std::list<std::string> &remote_server_list, std::string &
    ack_num = 0;
    MSS = max_seg_size;
    byte_index = 0;
+   packet_len = 0;
+   byte_offset = 0;
+   features = 0;
+   fanout = 0;
+   handshake_step = HANDSHAKE_DONE;
+   handshake_ok = false;
+   handshake_bandwidth_mbps = 0;
+   setup_host = 0;
+   setup_first = 0;
+   set_wire_version(1);
+
+   // Pick a random, non-zero v2 session identifier so that servers can discard packets from earlier transfers
+   std::random_device entropy;
+   do {
+      session_id = entropy();
+   } while (session_id == 0);
 
    // Timing initialization
    timeout_us = 0;
+   persist_us = 0;
    EstRTT = 1000000.0; // 1 Second in us
    DevRTT = 1000000.0; // 1 Second in us
 
    // Reporting counters intitialization
    packet_count = 0;
    loss_count = 0;
+   peer_repairs = 0;
+   receiver_stalls = 0;
 
    // Zero the input/output buffers
    bzero(out_buffer, MSG_LEN);
    bzero(in_buffer, MSG_LEN);
+}
+
+/**
+ * Resolve a remote host given as "hostname" or "hostname:port".
+ * @param spec the host specification
+ * @param default_port the port used when the specification has none
+ * @param address the resolved address
+ * @return true if the host was resolved
+ */
+bool MftpClient::resolve_host(const std::string &spec, int default_port, sockaddr_in &address) {
+   std::string hostname = spec;
+   int port = default_port;
+   size_t colon = spec.rfind(':');
+   if (colon != std::string::npos) {
+      hostname = spec.substr(0, colon);
+      port = atoi(spec.c_str() + colon + 1);
+   }
+
+   if (port <= 0 || port > 65535)
+      return false;
+
+   addrinfo hints, *result = nullptr;
+   bzero((char *) &hints, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+   if (getaddrinfo(hostname.c_str(), nullptr, &hints, &result) != 0 || result == nullptr)
+      return false;
+
+   address = *(const sockaddr_in *) result->ai_addr;
+   address.sin_port = htons(port);
+   freeaddrinfo(result);
+   return true;
+}
+
+/**
+ * Resolve remote hosts given as "hostname" or "hostname:port", with up to MAX_RESOLVER_THREADS lookups in flight, so
+ * that a long list of names costs about one round trip to the name server rather than one per name.
+ * @param specs the host specifications
+ * @param default_port the port used when a specification has none
+ * @param addresses the resolved addresses, in the order of the specifications
+ * @return per specification, true if it was resolved
+ */
+std::vector<bool> MftpClient::resolve_hosts(const std::vector<std::string> &specs, int default_port,
+                                            std::vector<sockaddr_in> &addresses) {
+   addresses.assign(specs.size(), sockaddr_in());
+   std::vector<char> resolved(specs.size(), 0); // Not vector<bool>: the workers write neighbouring elements
+   std::atomic<size_t> next(0);
+
+   // Each worker takes the next unresolved name until none is left; this thread is one of them
+   std::function<void()> worker = [&]() {
+      for (size_t i = next++; i < specs.size(); i = next++)
+         resolved[i] = resolve_host(specs[i], default_port, addresses[i]);
+   };
+   std::vector<std::thread> pool;
+   for (size_t t = 1; t < std::min(specs.size(), MAX_RESOLVER_THREADS); ++t)
+      pool.emplace_back(worker);
+   worker();
+   for (std::thread &t : pool)
+      t.join();
 
-   // Setup each remote server structure and emplace into remote server list
-   for (std::string &serv : remote_server_list) {
-      // UDP Setup
-      struct sockaddr_in *remote_addr = new sockaddr_in;
-      bzero((char *) remote_addr, sizeof(*remote_addr));
-      struct hostent *server = gethostbyname(serv.c_str());
-      remote_addr->sin_family = AF_INET;
-      bcopy((char *) server->h_addr, (char *) &remote_addr->sin_addr.s_addr, server->h_length);
-      remote_addr->sin_port = htons(port);
+   return std::vector<bool>(resolved.begin(), resolved.end());
+}
 
-      // Socket setup and create/emplace RemoteHost into remote_hosts list
-      int sockfd = create_unbound_UDP_socket(system_port);
-      remote_hosts.emplace_back(RemoteHost((sockaddr_in *) remote_addr, sockfd));
+/**
+ * Add a remote server to the remote_hosts table. Its socket is assigned by open_shared_sockets().
+ * @param address the server address
+ * @param name the name the server is reported under in the statistics
+ */
+void MftpClient::add_remote_host(const sockaddr_in &address, const std::string &name) {
+   // ACKs are matched to servers by their source address: the same server cannot be listed twice
+   if (remote_hosts.find(address) != remote_hosts.size()) {
+      warning("Server listed twice, ignoring: " + name);
+      return;
    }
+   remote_hosts.add(address, -1, &stats.add_host(name));
+}
 
-   // Log the start time of the transmission
-   local_time_logs.emplace_back(LogItem());
+/**
+ * Open the unconnected sockets the servers are reached through, one per HOSTS_PER_SOCKET servers (at most
+ * MAX_SHARED_SOCKETS), and assign them to the servers in turn. Each socket's receive buffer is sized to hold an ACK
+ * from each of its servers. Sockets opened before are closed first.
+ */
+void MftpClient::open_shared_sockets() {
+   close_shared_sockets();
+   size_t count = std::min((remote_hosts.size() + HOSTS_PER_SOCKET - 1) / HOSTS_PER_SOCKET, MAX_SHARED_SOCKETS);
+   for (size_t s = 0; s < count; ++s)
+      shared_sockets.push_back(create_unbound_UDP_socket(system_port));
+   for (int sockfd : shared_sockets)
+      set_socket_buffer(sockfd, SO_RCVBUF, ack_buffer_bytes());
+   for (size_t i = 0; i < remote_hosts.size(); ++i)
+      remote_hosts.sockfd[i] = shared_sockets[i % count];
 }
 
 /**
- * System destructor.
+ * Close the shared sockets.
  */
-MftpClient::~MftpClient() {
-   for (RemoteHost &r : remote_hosts) {
-      free(r.address);
+void MftpClient::close_shared_sockets() {
+   for (int sockfd : shared_sockets)
+      transport->close_socket(sockfd);
+   shared_sockets.clear();
+}
+
+/**
+ * The receive buffer a shared socket needs to hold one ACK from each of the servers it is shared by (in multipath
+ * mode, every server shares each socket).
+ * @return the buffer size in bytes
+ */
+int MftpClient::ack_buffer_bytes() const {
+   size_t hosts = remote_hosts.size();
+   if (!shared_sockets.empty() && (remote_hosts.empty() || remote_hosts.paths[0].empty()))
+      hosts = (hosts + shared_sockets.size() - 1) / shared_sockets.size();
+   return (int) std::min<size_t>(hosts * ACK_BUFFER_BYTES, MAX_SOCKET_BUFFER);
+}
+
+/**
+ * Start writing periodic JSON statistics snapshots while the transfer runs.
+ * @param path the snapshot file
+ * @param interval_ms time between snapshots in milliseconds
+ */
+void MftpClient::enable_stats(const std::string &path, uint32_t interval_ms) {
+   stats.start_export(path, interval_ms);
+}
+
+/**
+ * Record every data packet sent, retransmitted and acknowledged, and every timeout, in a binary trace (see MftpTrace).
+ * @param path the trace file
+ * @param records the capacity of the trace ring, in records
+ * @return false if the trace file could not be created
+ */
+bool MftpClient::enable_trace(const std::string &path, uint64_t records) {
+   return open_trace(path, records, MftpTrace::CLIENT, system_port);
+}
+
+/**
+ * Select the wire format for this transfer. Must be called before the first rdt_send(). Version 2 headers are larger,
+ * so the MSS is reduced if the packet would no longer fit in the output buffer.
+ * @param version 1 (legacy 8-byte header) or 2 (WireHeaderV2)
+ */
+void MftpClient::set_wire_version(int version) {
+   wire_version = version == 2 ? 2 : 1;
+   header_len = wire_version == 2 ? WireHeaderV2View::SIZE : LEGACY_HEADER_LEN;
+
+   if (MSS > MSG_LEN - header_len) {
+      warning("MSS " + std::to_string(MSS) + " does not fit in a packet, using " +
+              std::to_string(MSG_LEN - header_len));
+      MSS = MSG_LEN - header_len;
    }
 }
 
 /**
- * Shut down the client. Signal to the servers that we are done sending our file, and are closing the connections.
- * Log the distrubtion time, and call write_time_log() to output the datapoint to CSV.
+ * Distribute to the servers through a relay tree instead of sending to each of them. The servers are arranged, in the
+ * order given, as a k-ary tree below the client: the client sends to the first `fanout` servers only, and each server
+ * writes the file and forwards it to its own children. Must be called before handshake(), which sets up the relays.
+ * @param fanout the number of children of the client and of every server (0: send to every server directly)
  */
-void MftpClient::shutdown() {
-   // Shorten the MSS to the index that the byte_index pointer is currently set to, so that rdt_send() will transmit
-   // the packet even if it's not full. Store the configured MSS to be restored before running system reports.
-   uint16_t temp_mss = MSS;
-   MSS = byte_index;
+void MftpClient::set_fanout(uint16_t fanout) {
+   if (fanout == 0 || fanout >= remote_hosts.size())
+      return;
+
+   this->fanout = fanout;
+   features |= WireCapabilities::FEATURE_RELAY;
+   relay_tree = remote_hosts.address;
+
+   // Only the first tier is contacted directly
+   remote_hosts.truncate(fanout);
+   open_shared_sockets();
+}
+
+/**
+ * List the subtree below a node of the relay tree. Nodes are numbered as a k-ary heap: the client is node 0, the
+ * server at index i of relay_tree is node i + 1, and the children of node n are nodes k*n + 1 to k*n + k. The subtree is
+ * returned in breadth-first order, so it forms a k-ary heap again with the node itself as the root.
+ *
+ * @param node the root of the subtree
+ * @param count the number of nodes in the tree, including the client
+ * @param fanout the tree fan-out k
+ * @return the node numbers below the root, excluding the root itself
+ */
+std::vector<size_t> MftpClient::relay_subtree(size_t node, size_t count, uint16_t fanout) {
+   std::vector<size_t> nodes;
+   size_t first = node, last = node; // The current level of the subtree is the node range [first, last]
+   while (true) {
+      first = first * fanout + 1;
+      last = last * fanout + fanout;
+      if (first >= count)
+         break;
+      for (size_t n = first; n <= last && n < count; ++n)
+         nodes.push_back(n);
+   }
+   return nodes;
+}
+
+/**
+ * Let the servers repair each other's losses: servers cache the packets they receive, and a server that loses a packet
+ * asks its peers for it (NACK) before the client times out. Must be called before handshake(), which sends each server
+ * its peers. In a relay tree, every relay does the same for its children.
+ */
+void MftpClient::enable_peer_repair() {
+   features |= WireCapabilities::FEATURE_PEER_REPAIR;
+}
+
+/**
+ * Send over several local interfaces: every server is reached through one socket per local address (shared by all the
+ * servers), and each packet is scheduled on a path by the RTT and loss measured on it. Must be called before
+ * handshake(); the control packets use the first address.
+ * @param local_addresses comma-separated local IPv4 addresses (eg "192.168.1.10,10.0.0.10")
+ * @return false if an address is invalid or cannot be bound
+ */
+bool MftpClient::enable_multipath(const std::string &local_addresses) {
+   std::vector<in_addr> locals;
+   size_t start = 0;
+   while (start <= local_addresses.size()) {
+      size_t comma = std::min(local_addresses.find(',', start), local_addresses.size());
+      in_addr local;
+      if (inet_pton(AF_INET, local_addresses.substr(start, comma - start).c_str(), &local) != 1) {
+         error("Invalid local address: " + local_addresses.substr(start, comma - start));
+         return false;
+      }
+      locals.push_back(local);
+      start = comma + 1;
+   }
+
+   close_shared_sockets();
+   for (const in_addr &local : locals) {
+      int sockfd = create_local_UDP_socket(local);
+      if (sockfd < 0)
+         return false;
+      shared_sockets.push_back(sockfd);
+   }
+
+   for (size_t h = 0; h < remote_hosts.size(); ++h) {
+      std::vector<RemotePath> &paths = remote_hosts.paths[h];
+      for (size_t p = 0; p < locals.size(); ++p)
+         paths.emplace_back(RemotePath(shared_sockets[p], locals[p]));
+
+      // Stagger the servers over the paths, so that consecutive packets to different servers leave on different
+      // interfaces
+      paths[h % paths.size()].credit = 1.0;
+      remote_hosts.sockfd[h] = shared_sockets[0];
+   }
+   for (int sockfd : shared_sockets)
+      set_socket_buffer(sockfd, SO_RCVBUF, ack_buffer_bytes());
+   info("Multipath: " + std::to_string(locals.size()) + " local addresses");
+   return true;
+}
+
+/**
+ * The expected time for a packet on a path: its smoothed RTT (the best measured RTT of the host if not yet measured)
+ * scaled by the expected number of transmissions, 1 / (1 - loss).
+ * @param paths the paths to the remote host
+ * @param path the path index
+ * @return the expected delivery time in microseconds
+ */
+double MftpClient::path_cost(const std::vector<RemotePath> &paths, size_t path) {
+   double rtt = paths[path].srtt_us;
+   if (rtt == 0) {
+      for (const RemotePath &p : paths) {
+         if (p.srtt_us > 0 && (rtt == 0 || p.srtt_us < rtt))
+            rtt = p.srtt_us;
+      }
+   }
+   return std::max(rtt, 1.0) / (1.0 - std::min(paths[path].loss, MAX_PATH_LOSS));
+}
+
+/**
+ * Choose the path for a new packet to a host: weighted round-robin, each path's share proportional to 1 / cost^2.
+ * The square favours the better path (stop-and-wait pays the full delay of every packet) while a comparable path still
+ * carries a fair share of the load, and a poor one just enough to keep its estimate current.
+ * @param paths the paths to the remote host
+ * @return the path index
+ */
+size_t MftpClient::schedule_path(std::vector<RemotePath> &paths) {
+   std::vector<double> weights(paths.size());
+   double total = 0;
+   for (size_t i = 0; i < paths.size(); ++i) {
+      double cost = path_cost(paths, i);
+      weights[i] = 1.0 / (cost * cost);
+      total += weights[i];
+   }
+
+   size_t chosen = 0;
+   for (size_t i = 0; i < paths.size(); ++i) {
+      paths[i].credit += weights[i] / total;
+      if (paths[i].credit > paths[chosen].credit)
+         chosen = i;
+   }
+   paths[chosen].credit -= 1.0;
+   return chosen;
+}
+
+/**
+ * Choose the path for a retransmission: the one with the lowest expected delivery time.
+ * @param paths the paths to the remote host
+ * @return the path index
+ */
+size_t MftpClient::best_path(const std::vector<RemotePath> &paths) {
+   size_t best = 0;
+   for (size_t i = 1; i < paths.size(); ++i) {
+      if (path_cost(paths, i) < path_cost(paths, best))
+         best = i;
+   }
+   return best;
+}
+
+/**
+ * The socket a data packet to a host is sent on: the scheduled path in multipath mode.
+ * @param host the remote host index
+ * @return the socket
+ */
+int MftpClient::data_socket(size_t host) const {
+   const std::vector<RemotePath> &paths = remote_hosts.paths[host];
+   return paths.empty() ? remote_hosts.sockfd[host] : paths[remote_hosts.path[host]].sockfd;
+}
+
+/**
+ * Run the v2 capability handshake with every server before the first rdt_send():
+ *  1. SYN: advertise our capabilities; each SYN_ACK carries the server's receive buffer, largest segment, supported
+ *     features and checksum types, and gives a first RTT sample.
+ *  2. Probe the path MTU to each server with DF-flagged PROBE packets and pick the largest MSS that is safe for every
+ *     path and accepted by every server (or cap the configured MSS to it).
+ *  3. Size the socket buffers to the bandwidth-delay product, and confirm the MSS and receive buffer with a final
+ *     SYN (FLAG_CONFIRM).
+ *  4. With a relay fan-out, send the first-tier servers their subtrees (next_relay()); with peer repair, send every
+ *     server its repair peers (next_peer()).
+ * If any server does not answer the SYN, fall back to the legacy wire format; a relay tree cannot be set up then.
+ * The handshake waits for the replies; begin_handshake() and poll_handshake() run the same steps without blocking.
+ *
+ * @param bandwidth_mbps expected path bandwidth in Mbit/s, used for the bandwidth-delay product
+ * @return true if v2 was negotiated with every server and the relay tree (if any) was set up; false if the client fell
+ * back to the legacy format, or a relay could not be set up (with a relay tree, the transfer must not go ahead: part of
+ * the tree would never receive the file)
+ */
+bool MftpClient::handshake(uint32_t bandwidth_mbps) {
+   begin_handshake(bandwidth_mbps);
+   while (!poll_handshake(0))
+      ;
+   return handshake_ok;
+}
+
+/**
+ * Start the handshake (see handshake()) for callers that wait for the sockets themselves: send the SYN to every
+ * server. Call poll_handshake() when a reply may have arrived, and at the latest handshake_in_us() later.
+ * @param bandwidth_mbps expected path bandwidth in Mbit/s, used for the bandwidth-delay product
+ */
+void MftpClient::begin_handshake(uint32_t bandwidth_mbps) {
+   handshake_bandwidth_mbps = bandwidth_mbps;
+   handshake_step = SYN_STEP;
+   set_wire_version(2);
+
+   // 1. SYN: advertise our capabilities
+   WireCapabilitiesView caps(WireHeaderV2View(out_buffer).payload());
+   caps.set_recv_buffer(0);
+   caps.set_max_segment(MSG_LEN - WireHeaderV2View::SIZE);
+   caps.set_features(features);
+   caps.set_checksum_types(WireCapabilities::CHECKSUM_LEGACY_BYTES | WireCapabilities::CHECKSUM_V2_WORDS);
+   caps.set_selected_mss(0);
+   encode_v2_header(SYN, 0, 0, WireCapabilitiesView::SIZE);
+
+   exchange.replied.assign(remote_hosts.size(), false);
+   start_exchange(SYN_ACK, 0, WireHeaderV2View::SIZE + WireCapabilitiesView::SIZE, HANDSHAKE_ATTEMPTS,
+                  HANDSHAKE_WAIT_US);
+}
+
+/**
+ * Step of the handshake: process the replies that have arrived, retransmit if the wait for them expired, and go on
+ * to the next step once every server has replied (or the attempts are exhausted).
+ * @param flags recvfrom() flags for the first read of each socket (MSG_DONTWAIT to never wait for the socket timeout)
+ * @return true once the handshake has ended; handshake_result() then tells whether it succeeded
+ */
+bool MftpClient::poll_handshake(int flags) {
+   if (handshake_step != HANDSHAKE_DONE)
+      receive_replies(flags);
+   while (handshake_step != HANDSHAKE_DONE && exchange_done())
+      advance_handshake();
+   return handshake_step == HANDSHAKE_DONE;
+}
+
+/**
+ * The time until the handshake must be polled again if no reply arrives.
+ * @return microseconds until the current wait for replies expires
+ */
+uint_fast64_t MftpClient::handshake_in_us() const {
+   MftpTransport::TimePoint now = transport->now();
+   if (handshake_step == HANDSHAKE_DONE || now >= exchange.expiry)
+      return 0;
+   return std::chrono::duration_cast<std::chrono::microseconds>(exchange.expiry - now).count();
+}
+
+/**
+ * The exchange of the current step has ended: act on its replies and start the exchange of the next step.
+ */
+void MftpClient::advance_handshake() {
+   switch (handshake_step) {
+      case SYN_STEP:
+         if (exchange.pending == 0) {
+            begin_probes();
+            return;
+         }
+         warning("Handshake: not every server answered, falling back to the legacy wire format");
+         if (!relay_tree.empty())
+            error("Relay tree: requires the v2 wire format with every first-tier server");
+         set_wire_version(1);
+         if (MSS == 0)
+            MSS = ETHERNET_UDP_PAYLOAD - LEGACY_HEADER_LEN;
+         end_handshake(false);
+         return;
+
+      case PROBE_STEP: {
+         // The servers that echoed this size, and had not echoed a larger one, can receive it unfragmented
+         size_t size = probe_sizes.back();
+         probe_sizes.pop_back();
+         for (size_t i = 0; i < remote_hosts.size(); ++i) {
+            if (exchange.replied[i] && remote_hosts.path_payload[i] == 0 && size <= probe_bounds[i])
+               remote_hosts.path_payload[i] = size;
+         }
+         next_probe();
+         return;
+      }
+
+      case CONFIRM_STEP:
+         handshake_step = RELAY_STEP;
+         setup_host = 0;
+         next_relay();
+         return;
+
+      case RELAY_STEP:
+      case PEER_STEP:
+         if (exchange.pending > 0) {
+            std::string server = inet_ntoa(remote_hosts.address[setup_host].sin_addr);
+            if (handshake_step == RELAY_STEP) {
+               error("Relay tree: server " + server + " did not accept its " + std::to_string(setup_list.size()) +
+                     " relay hosts");
+               end_handshake(false);
+               return;
+            }
+            warning("Peer repair: server " + server + " did not accept its peers");
+         } else {
+            setup_first += std::min(setup_list.size() - setup_first, HOSTS_PER_SETUP);
+            if (setup_first < setup_list.size()) {
+               send_host_list_part();
+               return;
+            }
+         }
+         ++setup_host;
+         if (handshake_step == RELAY_STEP)
+            next_relay();
+         else
+            next_peer();
+         return;
+
+      case HANDSHAKE_DONE:
+         return;
+   }
+}
+
+/**
+ * End the handshake.
+ * @param negotiated the result reported by handshake() and handshake_result()
+ */
+void MftpClient::end_handshake(bool negotiated) {
+   handshake_step = HANDSHAKE_DONE;
+   handshake_ok = negotiated;
+}
+
+/**
+ * Start an exchange: send the packet in the output buffer to every host that is not marked in exchange.replied, and
+ * wait for the matching v2 replies (see receive_replies()), resending to the hosts that have not replied.
+ *
+ * @param reply_type the packet type expected in return
+ * @param offset the offset the reply must carry
+ * @param len the number of bytes of the output buffer to send
+ * @param attempts number of times to (re)send before giving up
+ * @param wait_us time to wait for replies after each send
+ */
+void MftpClient::start_exchange(int reply_type, uint64_t offset, size_t len, int attempts, uint_fast64_t wait_us) {
+   exchange.reply_type = reply_type;
+   exchange.offset = offset;
+   exchange.len = len;
+   exchange.pending = std::count(exchange.replied.begin(), exchange.replied.end(), false);
+   exchange.attempts = attempts;
+   exchange.wait_us = wait_us;
+   send_exchange();
+}
+
+/**
+ * Send the packet of the exchange to every host that has not replied yet, and restart the wait for replies.
+ */
+void MftpClient::send_exchange() {
+   exchange.sent = transport->now();
+   size_t sent_count = 0;
+   for (size_t i = 0; i < remote_hosts.size() && exchange.attempts > 0; ++i) {
+      if (!exchange.replied[i] &&
+          transport->send_to(remote_hosts.sockfd[i], out_buffer, exchange.len, remote_hosts.address[i]) >= 0)
+         ++sent_count;
+   }
+   --exchange.attempts;
+
+   // A probe larger than the known local path MTU is refused by the kernel (EMSGSIZE): nothing to wait for
+   if (sent_count == 0) {
+      exchange.attempts = 0;
+      exchange.expiry = exchange.sent;
+   } else {
+      exchange.expiry = exchange.sent + std::chrono::microseconds(exchange.wait_us);
+   }
+}
+
+/**
+ * Test whether the exchange has ended, resending if the wait for replies expired and attempts are left.
+ * @return true once every host has replied or the attempts are exhausted
+ */
+bool MftpClient::exchange_done() {
+   while (exchange.pending > 0 && transport->now() >= exchange.expiry) {
+      if (exchange.attempts <= 0)
+         return true;
+      send_exchange();
+   }
+   return exchange.pending == 0;
+}
+
+/**
+ * Collect the replies to the exchange that have arrived. Every shared socket is drained; a reply counts if it comes
+ * from a host that has not replied, with the expected type, session, offset and a valid checksum. SYN_ACK replies
+ * update the host's advertised capabilities and handshake RTT.
+ * @param flags recvfrom() flags for the first read of each socket
+ */
+void MftpClient::receive_replies(int flags) {
+   for (int sockfd : shared_sockets) {
+      for (int read_flags = flags;; read_flags = MSG_DONTWAIT) {
+         sockaddr_in from;
+         int n = transport->receive_from(sockfd, in_buffer, MSG_LEN, read_flags, &from);
+         if (n < 0)
+            break;
+         size_t i = remote_hosts.find(from);
+         if (i == remote_hosts.size() || exchange.replied[i])
+            continue;
+
+         WireHeaderV2View header(in_buffer);
+         if (n < (int) WireHeaderV2View::SIZE || !header.is_v2() || header.type() != exchange.reply_type ||
+             header.session_id() != session_id || header.offset() != exchange.offset || !valid_v2_checksum(n))
+            continue;
+
+         exchange.replied[i] = true;
+         --exchange.pending;
+         if (exchange.reply_type == SYN_ACK && header.payload_len() >= WireCapabilitiesView::SIZE) {
+            WireCapabilitiesView server_caps(header.payload());
+            remote_hosts.recv_buffer[i] = server_caps.recv_buffer();
+            remote_hosts.max_segment[i] = server_caps.max_segment();
+            remote_hosts.features[i] = server_caps.features() & features;
+            if (remote_hosts.handshake_rtt_us[i] == 0)
+               remote_hosts.handshake_rtt_us[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+                       transport->now() - exchange.sent).count();
+         }
+      }
+   }
+}
+
+/**
+ * Start discovering the largest UDP payload that reaches each server unfragmented. Sockets are switched to
+ * IP_PMTUDISC_DO (the DF bit is set and the kernel refuses datagrams above its path MTU estimate); PROBE packets of
+ * decreasing size are sent, starting at the transport's estimate, and the largest size a server echoes is that host's
+ * path payload.
+ */
+void MftpClient::begin_probes() {
+   static const size_t common_sizes[] = {MSG_LEN, ETHERNET_UDP_PAYLOAD, 1452, 1400, 1252, MIN_UDP_PAYLOAD};
+   handshake_step = PROBE_STEP;
+   probe_sizes.assign(common_sizes, common_sizes + sizeof(common_sizes) / sizeof(common_sizes[0]));
+   probe_bounds.resize(remote_hosts.size());
+
+   int pmtu_mode = IP_PMTUDISC_DO;
+   for (int sockfd : shared_sockets)
+      transport->set_option(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+
+   for (size_t i = 0; i < remote_hosts.size(); ++i) {
+      int mtu = transport->path_mtu(remote_hosts.address[i]);
+      probe_bounds[i] = mtu > 28 ? std::min((size_t) mtu - 28, (size_t) MSG_LEN) : MSG_LEN; // Less IPv4/UDP headers
+      probe_sizes.push_back(probe_bounds[i]);
+      remote_hosts.path_payload[i] = 0;
+   }
+
+   // Try the kernel's estimates first, then the common path sizes, largest first (from the back)
+   std::sort(probe_sizes.begin(), probe_sizes.end());
+   probe_sizes.erase(std::unique(probe_sizes.begin(), probe_sizes.end()), probe_sizes.end());
+   next_probe();
+}
 
-   // Send any remaining data in the buffer (the data character ' ' will be discarded)
-   rdt_send(' ');
+/**
+ * Probe the next size that some server without a path payload yet may receive, or end the probing.
+ */
+void MftpClient::next_probe() {
+   // Round RTT-based wait per probe size; a lost probe costs at most one retry
+   uint_fast64_t wait_us = 20000;
+   for (uint32_t rtt_us : remote_hosts.handshake_rtt_us)
+      wait_us = std::max<uint_fast64_t>(wait_us, 4 * rtt_us);
+
+   for (; !probe_sizes.empty(); probe_sizes.pop_back()) {
+      size_t size = probe_sizes.back();
+      for (size_t i = 0; i < remote_hosts.size(); ++i)
+         exchange.replied[i] = remote_hosts.path_payload[i] != 0 || size > probe_bounds[i];
+      if (std::count(exchange.replied.begin(), exchange.replied.end(), false) > 0) {
+         encode_v2_header(PROBE, 0, size, size - WireHeaderV2View::SIZE);
+         start_exchange(PROBE_ACK, size, size, 2, wait_us);
+         return;
+      }
+   }
+   end_probes();
+}
 
+/**
+ * End the path MTU probing and choose the largest MSS that fits every path and every server; then size the socket
+ * buffers to the bandwidth-delay product (bounded), and confirm the MSS and receive buffer with the servers.
+ */
+void MftpClient::end_probes() {
+   // Restore the default PMTU behaviour for the data transfer; hosts that never answered get the IPv4 minimum
+   int pmtu_mode = IP_PMTUDISC_WANT;
+   for (int sockfd : shared_sockets)
+      transport->set_option(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+   for (size_t i = 0; i < remote_hosts.size(); ++i) {
+      if (remote_hosts.path_payload[i] == 0)
+         remote_hosts.path_payload[i] = MIN_UDP_PAYLOAD;
+      verbose("Path payload to " + std::string(inet_ntoa(remote_hosts.address[i].sin_addr)) + ": " +
+              std::to_string(remote_hosts.path_payload[i]) + " bytes");
+   }
+
+   // 2. Path MTU: choose the largest MSS that fits every path and every server
+   size_t safe_mss = MSG_LEN - WireHeaderV2View::SIZE;
+   uint32_t max_rtt_us = 0;
+   for (size_t i = 0; i < remote_hosts.size(); ++i) {
+      safe_mss = std::min(safe_mss, (size_t) remote_hosts.path_payload[i] - WireHeaderV2View::SIZE);
+      safe_mss = std::min(safe_mss, (size_t) remote_hosts.max_segment[i]);
+      max_rtt_us = std::max(max_rtt_us, remote_hosts.handshake_rtt_us[i]);
+   }
+   if (MSS == 0) {
+      MSS = safe_mss;
+   } else if (MSS > safe_mss) {
+      warning("Handshake: MSS " + std::to_string(MSS) + " would fragment, using " + std::to_string(safe_mss));
+      MSS = safe_mss;
+   }
+
+   // 3. Socket buffers sized to the bandwidth-delay product (bounded), then confirm with the servers
+   uint64_t bdp = (uint64_t) handshake_bandwidth_mbps * 125000 * max_rtt_us / 1000000;
+   int buffer = (int) std::min<uint64_t>(std::max<uint64_t>(bdp, MIN_SOCKET_BUFFER), MAX_SOCKET_BUFFER);
+   int applied = 0;
+   for (int sockfd : shared_sockets) {
+      set_socket_buffer(sockfd, SO_SNDBUF, buffer);
+      applied = set_socket_buffer(sockfd, SO_RCVBUF, std::max(buffer, ack_buffer_bytes()));
+   }
+   info("Handshake: MSS " + std::to_string(MSS) + " bytes, RTT " + std::to_string(max_rtt_us) +
+        " us, socket buffers " + std::to_string(applied) + " bytes");
+
+   WireCapabilitiesView caps(WireHeaderV2View(out_buffer).payload());
+   caps.set_recv_buffer(buffer);
+   caps.set_max_segment(MSG_LEN - WireHeaderV2View::SIZE);
+   caps.set_features(features);
+   caps.set_checksum_types(WireCapabilities::CHECKSUM_LEGACY_BYTES | WireCapabilities::CHECKSUM_V2_WORDS);
+   caps.set_selected_mss(MSS);
+   encode_v2_header(SYN, WireHeaderV2::FLAG_CONFIRM, 0, WireCapabilitiesView::SIZE);
+
+   handshake_step = CONFIRM_STEP;
+   std::fill(exchange.replied.begin(), exchange.replied.end(), false);
+   start_exchange(SYN_ACK, 0, WireHeaderV2View::SIZE + WireCapabilitiesView::SIZE, HANDSHAKE_ATTEMPTS,
+                  HANDSHAKE_WAIT_US);
+}
+
+/**
+ * 4. Relay tree setup: send the next first-tier server with a subtree (from setup_host on) the part of the relay tree
+ * it forwards to, in RELAY_SETUP packets answered with RELAY_ACKs. Each server then runs the handshake and relay setup
+ * with its own children, and so on down the tree. Once every subtree is sent, go on to the repair peers. A first-tier
+ * server that cannot relay fails the handshake: the servers below it would never receive the file.
+ */
+void MftpClient::next_relay() {
+   for (; !relay_tree.empty() && setup_host < remote_hosts.size(); ++setup_host) {
+      std::vector<size_t> subtree = relay_subtree(setup_host + 1, relay_tree.size() + 1, fanout);
+      if (subtree.empty())
+         continue;
+      if (!(remote_hosts.features[setup_host] & WireCapabilities::FEATURE_RELAY)) {
+         error("Relay tree: server " + std::string(inet_ntoa(remote_hosts.address[setup_host].sin_addr)) +
+               " does not support relaying");
+         end_handshake(false);
+         return;
+      }
+
+      setup_list.clear();
+      for (size_t node : subtree)
+         setup_list.push_back(relay_tree[node - 1]);
+      setup_first = 0;
+      send_host_list_part();
+      return;
+   }
+   if (!relay_tree.empty())
+      verbose("Relay tree: fan-out " + std::to_string(fanout) + ", " + std::to_string(relay_tree.size()) +
+              " servers");
+
+   handshake_step = PEER_STEP;
+   setup_host = 0;
+   next_peer();
+}
+
+/**
+ * 4. Repair peers setup: send the next server that supports peer repair (from setup_host on) its peers, the next
+ * REPAIR_PEERS servers after it in remote_hosts, wrapping around. A server that does not accept them only loses peer
+ * repair.
+ */
+void MftpClient::next_peer() {
+   size_t count = std::min(REPAIR_PEERS, remote_hosts.size() - 1);
+   for (; count > 0 && setup_host < remote_hosts.size(); ++setup_host) {
+      if (!(remote_hosts.features[setup_host] & WireCapabilities::FEATURE_PEER_REPAIR))
+         continue;
+
+      setup_list.clear();
+      for (size_t i = 1; i <= count; ++i)
+         setup_list.push_back(remote_hosts.address[(setup_host + i) % remote_hosts.size()]);
+      setup_first = 0;
+      send_host_list_part();
+      return;
+   }
+   end_handshake(true);
+}
+
+/**
+ * Send server setup_host the part of its host list (WireRelaySetup payload) that starts at setup_first: a RELAY_SETUP
+ * answered with a RELAY_ACK in the relay step, a PEER_SETUP answered with a PEER_ACK in the peer step. A list longer
+ * than HOSTS_PER_SETUP is split over several packets, each acknowledged before the next is sent.
+ */
+void MftpClient::send_host_list_part() {
+   bool relay_step = handshake_step == RELAY_STEP;
+   size_t count = std::min(setup_list.size() - setup_first, HOSTS_PER_SETUP);
+   WireRelaySetupView setup(WireHeaderV2View(out_buffer).payload());
+   setup.set_fanout(relay_step ? fanout : 0);
+   setup.set_count(count);
+   for (size_t i = 0; i < count; ++i)
+      setup.set_host(i, setup_list[setup_first + i].sin_addr.s_addr, setup_list[setup_first + i].sin_port);
+   bool more = setup_first + count < setup_list.size();
+   encode_v2_header(relay_step ? RELAY_SETUP : PEER_SETUP, more ? WireHeaderV2::FLAG_MORE : 0, setup_first,
+                    WireRelaySetupView::length(count));
+
+   exchange.replied.assign(remote_hosts.size(), true);
+   exchange.replied[setup_host] = false;
+   start_exchange(relay_step ? RELAY_ACK : PEER_ACK, setup_first, WireHeaderV2View::SIZE +
+                  WireRelaySetupView::length(count), HANDSHAKE_ATTEMPTS, HANDSHAKE_WAIT_US);
+}
+
+/**
+ * Shut down the client. Send any data remaining in the buffer as a short last packet, then signal to the servers that
+ * we are done sending our file and close the connections (see finish()).
+ */
+void MftpClient::shutdown() {
+   if (begin_packet(true)) {
+      {
+         MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::ACK_WAIT);
+         SaW_process_acks_retransmissions();
+      }
+      complete_packet();
+   }
+   finish();
+}
+
+/**
+ * Signal to the servers that we are done sending our file, and are closing the connections. Log the distrubtion time,
+ * and call write_time_log() to output the datapoint to CSV. Every packet must have been acknowledged.
+ * @param fin_copies the number of FIN packets sent to each server (more than one when FIN is not acknowledged)
+ */
+void MftpClient::finish(int fin_copies) {
    // Create the FIN close-connection packet
-   bzero(out_buffer, MSG_LEN);
-   encode_seq_num(seq_num);
-   encode_packet_type(FIN);
+   if (wire_version == 2) {
+      encode_v2_header(FIN, 0, byte_offset, 0);
+   } else {
+      bzero(out_buffer, MSG_LEN);
+      encode_seq_num(seq_num);
+      encode_packet_type(FIN);
+   }
 
    // Send the close-connection packet to all servers and close sockets when done.
-   for (RemoteHost &r : remote_hosts) {
-      sendto(r.sockfd, out_buffer, MSS, 0, (const struct sockaddr *) &*r.address,
-             (socklen_t) sizeof(*r.address));
-      close(r.sockfd);
+   for (int repeat = 0; repeat < fin_copies; ++repeat) {
+      for (size_t i = 0; i < remote_hosts.size(); ++i)
+         transport->send_to(remote_hosts.sockfd[i], out_buffer, header_len, remote_hosts.address[i]);
    }
+   close_shared_sockets();
 
-   // Log the distribution time, restore the MSS, and write to the CSV log.
+   // Log the distribution time and write to the CSV log.
    local_time_logs.emplace_back(LogItem());
-   MSS = temp_mss;
    write_time_log();
+
+   // Write the final statistics snapshot
+   stats.stop_export();
 }
 
 /**
@@ -114,108 +931,476 @@ void MftpClient::shutdown() {
 void MftpClient::rdt_send(char data) {
    // If buffer is not full yet, add character and return
    if (byte_index < MSS) {
-      out_buffer[byte_index + 8] = data;
+      out_buffer[byte_index + header_len] = data;
       ++byte_index;
    }
-   // Buffer is full, begin formation of packet and transmit
+   // Buffer is full: transmit, Stop-and-Wait for acks (handling timer expiry & retransmissions), and move on
    else {
-      // If this is a new transmission, update the expected ACK number.
-      if (ack_num == seq_num)
-         ++ack_num;
+      begin_packet(false);
+      {
+         MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::ACK_WAIT);
+         SaW_process_acks_retransmissions();
+      }
+      complete_packet();
 
-      // Encode the sequence number, compute checksum, and set packet type into packet header in buffer.
-      encode_seq_num(seq_num);
-      encode_packet_type(DATA_PACKET);
-      encode_checksum();
+      // Call self ONCE to write the byte we received from the rdt_send() API caller to the buffer
+      rdt_send(data);
+   }
+}
+
+/**
+ * Copy bytes from the caller's byte stream into the output buffer, without transmitting.
+ * @param data the bytes
+ * @param len the number of bytes
+ * @return the number of bytes taken (0 once the buffer holds a full packet)
+ */
+size_t MftpClient::fill(const char *data, size_t len) {
+   size_t n = std::min<size_t>(MSS - byte_index, len);
+   memcpy(out_buffer + header_len + byte_index, data, n);
+   byte_index += n;
+   return n;
+}
 
-      // Set a timer
-      timeout_start = std::chrono::steady_clock::now();
+/**
+ * Transmit the packet in the output buffer to every server, if it is full (or, for the last packet of the stream,
+ * holds any data). The caller then waits for the ACKs and calls complete_packet().
+ * @param last the stream has ended: send a partly filled buffer as a short packet
+ * @return true if a packet was transmitted
+ */
+bool MftpClient::begin_packet(bool last) {
+   if (byte_index == 0 || (byte_index < MSS && !last))
+      return false;
+
+   // Profiling: the time spent filling the buffer since the last packet was acked
+   if (profiler)
+      profiler->add_phase_time(MftpProfiler::PACKETIZE, std::chrono::steady_clock::now() - packetize_start);
 
-      // Send the packet
-      for (RemoteHost &r : remote_hosts) {
-         if (r.ack_num == seq_num) {
-            sendto(r.sockfd, out_buffer, MSS + 8, 0, (const struct sockaddr *) &*r.address,
-                   (socklen_t) sizeof(*r.address));
+   // If this is a new transmission, update the expected ACK number.
+   if (ack_num == seq_num)
+      ++ack_num;
+   packet_len = byte_index;
+
+   // Encode the sequence number (v2: byte offset and length), compute checksum, and set packet type into
+   // packet header in buffer.
+   {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::CHECKSUM);
+      if (wire_version == 2) {
+         encode_v2_header(DATA_PACKET, 0, byte_offset, packet_len);
+      } else {
+         encode_seq_num(seq_num);
+         encode_packet_type(DATA_PACKET);
+         encode_checksum();
+      }
+   }
+
+   // Set a timer
+   timeout_start = transport->now();
+   packet_start = timeout_start;
+   mark_first_packet();
+
+   // Send the packet to every host; each one is outstanding until it acknowledges
+   remote_hosts.unacked.insert_all();
+   {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::SEND);
+      for (size_t i = 0; i < remote_hosts.size(); ++i) {
+         std::vector<RemotePath> &paths = remote_hosts.paths[i];
+         if (!paths.empty()) {
+            remote_hosts.path[i] = schedule_path(paths);
+            remote_hosts.retransmitted[i] = false;
+            ++paths[remote_hosts.path[i]].packets_sent;
          }
+         trace(MftpTrace::SEND, remote_hosts.address[i], seq_num, byte_offset, packet_len);
+         transport->send_to(data_socket(i), out_buffer, packet_len + header_len, remote_hosts.address[i]);
+         stats.add(remote_hosts.stats[i]->packets_sent);
       }
+      if (profiler)
+         profiler->count_syscalls(remote_hosts.size());
+   }
+   stats.add(stats.packets_sent, remote_hosts.size());
+   stats.set_window_occupancy(remote_hosts.unacked.count());
+   return true;
+}
 
-      // Stop-and-Wait for acks, and handle timer expiry & retransmissions
-      SaW_process_acks_retransmissions();
+/**
+ * Record the time from startup to the first data packet, when it is sent.
+ */
+void MftpClient::mark_first_packet() {
+   if (first_packet_us == 0)
+      first_packet_us = std::max<uint_fast64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - startup_start).count(), 1);
+}
 
-      // Once all acks received, reset buffer, increment sequence number
-      byte_index = 0;
+/**
+ * Once every server has acknowledged the packet in the output buffer, reset the buffer and increment the sequence
+ * number.
+ */
+void MftpClient::complete_packet() {
+   stats.add(stats.payload_bytes, packet_len);
+   if (profiler) {
+      profiler->count_packet(packet_len);
+      packetize_start = std::chrono::steady_clock::now();
+   }
+   byte_index = 0;
+   byte_offset += packet_len;
+   ++seq_num;
+   ++packet_count;
+
+   // The legacy checksum covers the whole buffer, so unused bytes must be zero. v2 checksums only the payload.
+   if (wire_version != 2)
       bzero(out_buffer, MSG_LEN);
-      ++seq_num;
-      ++packet_count;
 
-      // Report to console if we have reached a milestone in MiB transmitted
-      if((seq_num * MSS) % 1048576 < MSS && seq_num > 2)
-         info(std::to_string((seq_num * MSS) / 1048576) + " MiB transmitted.");
+   // Report to console if we have reached a milestone in MiB transmitted
+   if(byte_offset % 1048576 < packet_len && seq_num > 2)
+      logger.log(MftpLogger::INFO, "{} MiB transmitted.", byte_offset / 1048576);
+}
 
-      // Call self ONCE to write the byte we received from the rdt_send() API caller to the buffer
-      rdt_send(data);
+/**
+ * Send a block of bytes from the caller's byte stream. Equivalent to calling rdt_send() for every byte, but copies
+ * whole runs into the output buffer.
+ * @param data the bytes to send
+ * @param len the number of bytes
+ */
+void MftpClient::rdt_send_block(const char *data, size_t len) {
+   while (len > 0) {
+      // A full buffer is transmitted by rdt_send() when the next byte arrives
+      if (byte_index == MSS) {
+         rdt_send(*data);
+         ++data;
+         --len;
+         continue;
+      }
+
+      size_t n = fill(data, len);
+      data += n;
+      len -= n;
    }
 }
 
+/**
+ * Send a file as a fountain-coded carousel, then shut down. The file is cut into equal source blocks of at most
+ * CAROUSEL_BLOCK_SYMBOLS symbols (LT codes need more overhead for small blocks), and each block of K symbols into
+ * K * overhead + 2 sqrt(K) LT-encoded symbols per round; the symbols of CAROUSEL_WINDOW_BLOCKS consecutive blocks are
+ * interleaved so that a burst of losses is spread over all of them.
+ * There are no ACKs and no retransmissions: a server decodes each block from any slightly more than K of its symbols.
+ * Each round cycles over the whole file again with new seeds, so a server that lost more than the overhead of one
+ * round, or joined late, still collects enough symbols; with a single round, such a server cannot decode the file.
+ * Sending to a multicast group reaches every server that joined it with a single packet.
+ *
+ * @param in the file contents (seekable when there are several rounds)
+ * @param file_size the file size in bytes
+ * @param overhead encoded symbols sent per source symbol and round (above 1, eg 1.3)
+ * @param rate_mbps sending rate in Mbit/s (per destination)
+ * @param rounds the number of passes over the file
+ * @return false if the MSS leaves no room for a symbol after the carousel header
+ */
+bool MftpClient::send_carousel(std::istream &in, uint64_t file_size, double overhead, uint32_t rate_mbps,
+                               uint32_t rounds) {
+   set_wire_version(2);
+   if (MSS == 0)
+      MSS = ETHERNET_UDP_PAYLOAD - WireHeaderV2View::SIZE;
+   if (MSS <= WireCarouselView::SIZE) {
+      error("Carousel: the MSS must be larger than the " + std::to_string(WireCarouselView::SIZE) +
+            "-byte symbol header");
+      return false;
+   }
+   size_t symbol_size = MSS - WireCarouselView::SIZE;
+   uint64_t file_symbols = (file_size + symbol_size - 1) / symbol_size;
+   uint64_t blocks = std::max<uint64_t>((file_symbols + CAROUSEL_BLOCK_SYMBOLS - 1) / CAROUSEL_BLOCK_SYMBOLS, 1);
+   uint32_t block_bytes = (uint32_t) ((file_symbols + blocks - 1) / blocks * symbol_size);
+   size_t packet_len = header_len + MSS;
+   std::vector<char> window((size_t) block_bytes * CAROUSEL_WINDOW_BLOCKS);
+
+   // Pacing: the time one packet takes at the configured rate
+   std::chrono::steady_clock::duration interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+           std::chrono::duration<double, std::micro>(packet_len * 8.0 / std::max<uint32_t>(rate_mbps, 1)));
+   std::chrono::steady_clock::time_point next_send = std::chrono::steady_clock::now();
+
+   WireCarouselView carousel(WireHeaderV2View(out_buffer).payload());
+   carousel.set_file_size(file_size);
+   carousel.set_block_bytes(block_bytes);
+
+   for (uint32_t round = 0; round < rounds; ++round) {
+      if (round > 0) {
+         in.clear();
+         in.seekg(0);
+      }
+      for (uint64_t window_offset = 0; window_offset < file_size; window_offset += window.size()) {
+         size_t window_len = (size_t) std::min<uint64_t>(window.size(), file_size - window_offset);
+         in.read(window.data(), window_len);
+         if ((size_t) in.gcount() != window_len) {
+            error("Carousel: the input ended before the announced file size");
+            std::fill(window.begin() + in.gcount(), window.begin() + window_len, 0);
+         }
+
+         std::vector<LtEncoder> encoders;
+         std::vector<uint32_t> symbols;
+         for (size_t start = 0; start < window_len; start += block_bytes) {
+            encoders.emplace_back(window.data() + start, std::min<size_t>(block_bytes, window_len - start),
+                                  symbol_size);
+            uint32_t K = encoders.back().source_symbols();
+            symbols.push_back((uint32_t) std::ceil(K * overhead + 2 * std::sqrt((double) K)));
+         }
+         uint32_t burst = *std::max_element(symbols.begin(), symbols.end());
+
+         // Each round continues the seeds of the one before, so that its symbols are new to every server
+         for (uint32_t s = 0; s < burst; ++s) {
+            for (size_t b = 0; b < encoders.size(); ++b) {
+               if (s >= symbols[b])
+                  continue;
+               uint32_t seed = round * symbols[b] + s;
+
+               {
+                  MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::PACKETIZE);
+                  encoders[b].encode(seed, carousel.symbol());
+                  carousel.set_seed(seed);
+                  encode_v2_header(CAROUSEL, 0, window_offset + b * block_bytes, MSS);
+               }
+
+               std::this_thread::sleep_until(next_send);
+               next_send = std::max(next_send + interval, std::chrono::steady_clock::now() - 10 * interval);
+               mark_first_packet();
+
+               MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::SEND);
+               for (size_t i = 0; i < remote_hosts.size(); ++i) {
+                  trace(MftpTrace::SEND, remote_hosts.address[i], seed, window_offset + b * block_bytes,
+                        symbol_size);
+                  transport->send_to(remote_hosts.sockfd[i], out_buffer, packet_len, remote_hosts.address[i]);
+               }
+               stats.add(stats.packets_sent, remote_hosts.size());
+               stats.add(stats.payload_bytes, symbol_size);
+               if (profiler) {
+                  profiler->count_syscalls(remote_hosts.size());
+                  profiler->count_packet(symbol_size);
+               }
+               ++packet_count;
+            }
+         }
+
+         logger.log(MftpLogger::INFO, "{} MiB transmitted.", (window_offset + window_len) / 1048576);
+      }
+   }
+
+   // FIN is not acknowledged in the carousel: repeat it so that lossy receivers still learn the stream has ended
+   byte_offset = file_size;
+   finish(CAROUSEL_FIN_REPEATS);
+   return true;
+}
+
+/**
+ * List the sockets on which the ACKs of the servers arrive.
+ * @return the shared sockets
+ */
+std::vector<int> MftpClient::sockets() const {
+   return shared_sockets;
+}
+
 /**
  * Implement the "and Wait" of the stop-and-wait protocol: Check for ACKs from remote hosts and monitor the timeout
  * timer. In case of a timeout before all ACKs received, retransmit to any hosts that have not acked.
  */
 void MftpClient::SaW_process_acks_retransmissions() {
    while (!all_acked()) {
-      // Check to see if new acks have come in
-      for (RemoteHost &r : remote_hosts) {
-         if (r.ack_num == seq_num) {
-            bzero(in_buffer, MSG_LEN);
-            socklen_t length = sizeof(&*r.address);
-            int n = recvfrom(r.sockfd, (char *) in_buffer, MSG_LEN, 0, (struct sockaddr *) &*r.address,
-                             &length);
-
-            // A packet was received, process the ACK and update the timeout
-            if (n > 0) {
-               uint32_t temp_seq_num = decode_seq_num();
-               if (temp_seq_num == seq_num + 1) {
-                  r.ack_num = temp_seq_num;
-                  ++r.segment_num;
-                  estimate_timeout();
-               }
-            }
+      receive_acks(0);
+      retransmit_expired();
+   }
+}
+
+/**
+ * Step of the stop-and-wait protocol for callers that wait for the ACKs themselves (eg on an event loop): process the
+ * ACKs that have arrived and retransmit if the timer expired. Once every server has acknowledged, the packet is
+ * completed as by complete_packet().
+ * @return true once the packet in flight is acknowledged by every server
+ */
+bool MftpClient::poll_acks() {
+   receive_acks(MSG_DONTWAIT);
+   if (all_acked()) {
+      if (profiler)
+         profiler->add_phase_time(MftpProfiler::ACK_WAIT, transport->now() - packet_start);
+      complete_packet();
+      return true;
+   }
+   retransmit_expired();
+   return false;
+}
+
+/**
+ * Check for ACKs from the remote hosts that have not acknowledged the packet in the output buffer, and update the
+ * timeout from each one. Every shared socket is drained, and each datagram is matched to its host by source address.
+ * @param flags recvfrom() flags for the first read of each socket (MSG_DONTWAIT to never wait for the socket timeout)
+ */
+void MftpClient::receive_acks(int flags) {
+   for (size_t s = 0; s < shared_sockets.size(); ++s) {
+      for (int read_flags = flags;; read_flags = MSG_DONTWAIT) {
+         sockaddr_in from;
+         int n = transport->receive_from(shared_sockets[s], (char *) in_buffer, MSG_LEN, read_flags, &from);
+         if (profiler)
+            profiler->count_syscalls();
+         if (n < 0)
+            break;
+         if (n == 0)
+            continue;
+
+         stats.add(stats.packets_received);
+         size_t host = remote_hosts.find(from);
+         if (host != remote_hosts.size() && remote_hosts.unacked.contains(host))
+            process_ack(host, s, n);
+      }
+   }
+}
+
+/**
+ * Process a packet from a remote host that has not acknowledged the packet in the output buffer: an ACK samples the
+ * RTT and updates the timeout, a backpressure ACK delays the next retransmission.
+ * @param host the remote host index
+ * @param path the path the packet arrived on (in multipath mode, the index of the shared socket)
+ * @param received_len number of bytes returned by recvfrom()
+ */
+void MftpClient::process_ack(size_t host, size_t path, int received_len) {
+   if (valid_ack(received_len)) {
+      remote_hosts.unacked.erase(host);
+
+      // Sample the RTT (since the last transmission) and ACK latency (since the first transmission)
+      HostStats *host_stats = remote_hosts.stats[host];
+      std::chrono::steady_clock::time_point now = transport->now();
+      long double SampRTT = std::chrono::duration_cast<std::chrono::microseconds>(now - timeout_start).count();
+      host_stats->rtt.record((uint64_t) SampRTT);
+      host_stats->ack_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(now - packet_start).count());
+      stats.add(host_stats->acks);
+      stats.set_window_occupancy(remote_hosts.unacked.count());
+
+      // The server got this packet from a peer rather than from us
+      bool repaired = wire_version == 2 && (WireHeaderV2View(in_buffer).flags() & WireHeaderV2::FLAG_PEER_REPAIR);
+      if (repaired) {
+         ++peer_repairs;
+         stats.add(stats.peer_repairs);
+      }
+      trace(MftpTrace::ACK_RECEIVED, remote_hosts.address[host], seq_num, byte_offset, packet_len,
+            repaired ? MftpTrace::REPAIRED : 0);
+
+      // Multipath: an ACK for the first transmission, on the path that carried it, is an RTT sample
+      std::vector<RemotePath> &paths = remote_hosts.paths[host];
+      if (!paths.empty()) {
+         RemotePath &p = paths[path];
+         ++p.packets_acked;
+         if (!remote_hosts.retransmitted[host] && path == remote_hosts.path[host]) {
+            p.srtt_us = p.srtt_us == 0 ? (double) SampRTT :
+                        (1 - PATH_RTT_GAIN) * p.srtt_us + PATH_RTT_GAIN * (double) SampRTT;
+            p.loss *= 1 - PATH_LOSS_GAIN;
          }
       }
 
-      // If we've hit a timeout condition, report to terminal and retransmit.
-      if (((uint_fast64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
-                                                                                 timeout_start).count()) >= timeout_us) {
-         error("Timeout, sequence number = " + std::to_string(seq_num));
+      persist_us = 0;
+      remote_hosts.stalled[host] = false;
+      estimate_timeout(SampRTT);
+   }
+   // The server is alive but its output is full: wait longer before probing again, without treating the stall as a
+   // loss
+   else if (backpressure_ack(received_len)) {
+      persist_us = persist_us == 0 ? MIN_PERSIST_US : std::min(persist_us * 2, MAX_PERSIST_US);
+      remote_hosts.stalled[host] = true;
+      timeout_start = transport->now();
+      ++receiver_stalls;
+      stats.add(stats.receiver_stalls);
+      trace(MftpTrace::STALL, remote_hosts.address[host], seq_num, byte_offset, packet_len, MftpTrace::HELD);
+   }
+}
 
-         //Reset the timer and increment the loss counter (for reports)
-         timeout_start = std::chrono::steady_clock::now();
+/**
+ * If we've hit a timeout condition, report to terminal and retransmit to any hosts that have not acked.
+ */
+void MftpClient::retransmit_expired() {
+   if (retransmit_in_us() == 0) {
+      //Reset the timer and increment the loss counter (for reports), unless this is a probe of a stalled server
+      timeout_start = transport->now();
+      if (persist_us == 0) {
+         logger.log(MftpLogger::ERROR, "Timeout, sequence number = {}", seq_num);
          ++loss_count;
-
-         // Retransmit the packet to any host that hasn't ACKed
-         for (RemoteHost &r : remote_hosts) {
-            if (r.ack_num == seq_num) {
-               sendto(r.sockfd, out_buffer, MSS + 8, 0, (const struct sockaddr *) &*r.address,
-                      (socklen_t) sizeof(*r.address));
-            }
+         stats.add(stats.timeouts);
+         if (tracer) {
+            sockaddr_in every_host;
+            bzero(&every_host, sizeof(every_host));
+            trace(MftpTrace::TIMEOUT, every_host, seq_num, byte_offset, packet_len, 0, remote_hosts.unacked.count());
          }
       }
+
+      // Retransmit the packet to any host that hasn't ACKed; to a stalled host, this is a probe. In multipath mode,
+      // the timeout counts as a loss on the path that carried the packet, and the retransmission goes out on the best
+      // path.
+      remote_hosts.unacked.for_each([this](size_t i) {
+         std::vector<RemotePath> &paths = remote_hosts.paths[i];
+         if (!paths.empty()) {
+            uint32_t &path = remote_hosts.path[i];
+            if (!remote_hosts.stalled[i])
+               paths[path].loss += PATH_LOSS_GAIN * (1.0 - paths[path].loss);
+            path = best_path(paths);
+            remote_hosts.retransmitted[i] = true;
+            ++paths[path].packets_sent;
+         }
+         trace(MftpTrace::RETRANSMIT, remote_hosts.address[i], seq_num, byte_offset, packet_len,
+               remote_hosts.stalled[i] ? MftpTrace::BY_PERSIST : MftpTrace::BY_TIMEOUT);
+         transport->send_to(data_socket(i), out_buffer, packet_len + header_len, remote_hosts.address[i]);
+         stats.add(remote_hosts.stats[i]->packets_sent);
+         stats.add(remote_hosts.stats[i]->retransmissions);
+         stats.add(stats.packets_sent);
+         stats.add(stats.retransmissions);
+         if (profiler)
+            profiler->count_syscalls();
+      });
    }
 }
 
+/**
+ * Time left until the packet in flight is retransmitted. While a server reports backpressure, this is the persist
+ * interval instead of the retransmission timeout.
+ * @return microseconds until the retransmission (0 if it is due)
+ */
+uint_fast64_t MftpClient::retransmit_in_us() const {
+   uint_fast64_t elapsed = (uint_fast64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+           transport->now() - timeout_start).count();
+   uint_fast64_t limit = std::max(timeout_us, persist_us);
+   return elapsed >= limit ? 0 : limit - elapsed;
+}
+
 /**
  * Update the timer expiration values based on the TCP-Timeout estimation algorithm using the Round-Trip Time
  * moving averages EstimatedRTT and DeviationRTT
+ * @param SampRTT the RTT sample (in microseconds) taken from the ACK that was just received
  */
-void MftpClient::estimate_timeout() {
-   // Sample the current RTT
-   long double SampRTT = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
-                                                                               timeout_start).count();
+void MftpClient::estimate_timeout(long double SampRTT) {
    // Compute the estimatedRTT, DevRTT, and timeout
    EstRTT = (0.875 * EstRTT) + (0.125 * SampRTT);
    DevRTT = (0.75 * DevRTT) + (0.25 * std::abs(EstRTT - SampRTT));
    timeout_us = (uint_fast64_t) (EstRTT + (4 * DevRTT));
-   verbose("The estimated timeout is (in microsec): " + std::to_string(timeout_us));
+   logger.log(MftpLogger::VERBOSE, "The estimated timeout is (in microsec): {}", timeout_us);
+}
+
+/**
+ * Determine whether the packet in the input buffer acknowledges the packet currently in the output buffer. Legacy ACKs
+ * carry the next sequence number; v2 ACKs carry the next expected byte offset for this session.
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if this is the ACK we are waiting for
+ */
+bool MftpClient::valid_ack(int received_len) {
+   if (wire_version == 2) {
+      WireHeaderV2View header(in_buffer);
+      return header.is_v2() && header.type() == ACK && header.session_id() == session_id &&
+             header.offset() == byte_offset + packet_len && valid_v2_checksum(received_len);
+   }
+   return decode_seq_num() == seq_num + 1;
+}
+
+/**
+ * Determine whether the packet in the input buffer is a v2 backpressure ACK for the packet in the output buffer: the
+ * server received it, but could not queue it for its output (stream or relay subtree) and did not accept it.
+ * Legacy servers simply withhold the ACK.
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if the server asks us to hold the current packet
+ */
+bool MftpClient::backpressure_ack(int received_len) {
+   WireHeaderV2View header(in_buffer);
+   return wire_version == 2 && header.is_v2() && header.type() == ACK && header.session_id() == session_id &&
+          (header.flags() & WireHeaderV2::FLAG_BACKPRESSURE) && header.offset() == byte_offset &&
+          valid_v2_checksum(received_len);
 }
 
 /**
@@ -223,13 +1408,7 @@ void MftpClient::estimate_timeout() {
  * @return true if all acks have been received, false if unacked servers
  */
 bool MftpClient::all_acked() {
-   for (RemoteHost &r : remote_hosts) {
-      // Found an un-acked host
-      if (r.ack_num == seq_num)
-         return false;
-   }
-   // all acks are received.
-   return true;
+   return remote_hosts.unacked.empty();
 }
 
 /**
@@ -239,6 +1418,12 @@ bool MftpClient::all_acked() {
 void MftpClient::write_time_log() {
    std::string outgoing_message;
 
+   // Relays keep no CSV log of their own
+   if (log.empty()) {
+      system_report();
+      return;
+   }
+
    // Grab the "zero" time and open the log file
    LogItem t = local_time_logs[0];
    std::ofstream csv_file(log, std::ios_base::app);
@@ -247,8 +1432,8 @@ void MftpClient::write_time_log() {
    double percentage =
            (round(((double) loss_count / (double) packet_count) * 1000) / 1000) / (double) remote_hosts.size();
 
-   // Create the CSV line
-   outgoing_message = std::to_string(remote_hosts.size()) + ", " +
+   // Create the CSV line (the number of servers includes those reached through relays)
+   outgoing_message = std::to_string(relay_tree.empty() ? remote_hosts.size() : relay_tree.size()) + ", " +
                       std::to_string(MSS) + ", " +
                       std::to_string(percentage) + ", " +
                       std::to_string(((float) std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -275,5 +1460,32 @@ void MftpClient::system_report() {
    warning("                 Estimated Effective Loss Rate    : " + std::to_string(percentage));
    warning("                 Current Timeout Setting (s)      : " + std::to_string((double)timeout_us / 1000000));
    warning("                 ExpMovingAvg EstimatedRTT (s)    : " + std::to_string(EstRTT / 1000000));
+   warning("                 Startup: Resolve / 1st Packet (s): " + std::to_string((double) resolve_us / 1000000) +
+           " / " + std::to_string((double) first_packet_us / 1000000));
+   if (features & WireCapabilities::FEATURE_PEER_REPAIR)
+      warning("                 Packets Repaired by Peers        : " + std::to_string(peer_repairs));
+   if (receiver_stalls > 0)
+      warning("                 Receiver Backpressure Stalls     : " + std::to_string(receiver_stalls));
+   if (!relay_tree.empty())
+      warning("                 Relay Tree Fan-out / Servers     : " + std::to_string(fanout) + " / " +
+              std::to_string(relay_tree.size()));
+
+   // Multipath: packets sent and mean RTT and loss estimates of each local address, over all servers
+   for (size_t i = 0; !remote_hosts.empty() && i < remote_hosts.paths[0].size(); ++i) {
+      uint64_t sent = 0;
+      double rtt = 0, loss = 0;
+      for (const std::vector<RemotePath> &paths : remote_hosts.paths) {
+         sent += paths[i].packets_sent;
+         rtt += paths[i].srtt_us / remote_hosts.size();
+         loss += paths[i].loss / remote_hosts.size();
+      }
+      std::string local(inet_ntoa(remote_hosts.paths[0][i].local));
+      warning("                 Path " + local + std::string(local.size() < 15 ? 15 - local.size() : 0, ' ') +
+              " Sent/RTT(ms)/Loss: " + std::to_string(sent) + " / " + std::to_string(rtt / 1000) + " / " +
+              std::to_string(loss));
+   }
    warning(" * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *  ");
+
+   if (profiler)
+      profiler->report();
 }
\ No newline at end of file
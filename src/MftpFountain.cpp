@@ -0,0 +1,228 @@
+/**
+ * MftpFountain.cpp implements the LT (Luby Transform) fountain code used by the carousel mode: the robust soliton
+ * degree distribution, seed-driven neighbour selection, the block encoder and the peeling decoder.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MftpFountain.h"
+
+namespace {
+   // Robust soliton parameters: c scales the expected number of degree-one symbols, delta bounds the decoding failure
+   // probability at K(1 + overhead) symbols. A larger c raises the mean degree, so that few source symbols are left
+   // uncovered when some of the stream is lost.
+   const double SOLITON_C = 0.1;
+   const double SOLITON_DELTA = 0.5;
+
+   /**
+    * SplitMix64: a small, portable generator, so that every host derives the same neighbours from a seed.
+    */
+   struct SplitMix64 {
+      uint64_t state;
+
+      explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+      uint64_t next() {
+         uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+         z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+         z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+         return z ^ (z >> 31);
+      }
+
+      // Uniform in [0, 1)
+      double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+   };
+}
+
+/**
+ * Build the robust soliton distribution for a block size.
+ * @param source_symbols the number of source symbols K
+ * @param symbol_size the symbol size in bytes
+ */
+LtCode::LtCode(uint32_t source_symbols, size_t symbol_size) : K(std::max<uint32_t>(source_symbols, 1)),
+                                                              size(symbol_size) {
+   double R = SOLITON_C * std::log(K / SOLITON_DELTA) * std::sqrt((double) K);
+   uint32_t spike = R > 0 ? (uint32_t) std::max(1.0, std::min((double) K, std::floor(K / R))) : K;
+
+   std::vector<double> mu(K + 1, 0.0);
+   for (uint32_t d = 1; d <= K; ++d) {
+      double rho = d == 1 ? 1.0 / K : 1.0 / ((double) d * (d - 1));
+      double tau = 0.0;
+      if (d < spike)
+         tau = R / ((double) d * K);
+      else if (d == spike)
+         tau = R * std::log(R / SOLITON_DELTA) / K;
+      mu[d] = rho + std::max(tau, 0.0);
+   }
+
+   double total = 0.0;
+   for (uint32_t d = 1; d <= K; ++d)
+      total += mu[d];
+   degree_cdf.resize(K);
+   double sum = 0.0;
+   for (uint32_t d = 1; d <= K; ++d) {
+      sum += mu[d];
+      degree_cdf[d - 1] = sum / total;
+   }
+   degree_cdf[K - 1] = 1.0;
+}
+
+/**
+ * List the source symbols combined into the encoded symbol with the given seed.
+ * @param seed the encoded symbol's seed
+ * @param out receives the distinct source symbol indices
+ */
+void LtCode::neighbours(uint32_t seed, std::vector<uint32_t> &out) const {
+   SplitMix64 random(((uint64_t) seed << 32) ^ K);
+   uint32_t degree = (uint32_t) (std::lower_bound(degree_cdf.begin(), degree_cdf.end(), random.unit()) -
+                                 degree_cdf.begin()) + 1;
+   degree = std::min(degree, K);
+
+   out.clear();
+   while (out.size() < degree) {
+      uint32_t index = (uint32_t) (random.next() % K);
+      if (std::find(out.begin(), out.end(), index) == out.end())
+         out.push_back(index);
+   }
+}
+
+/**
+ * XOR a run of bytes into another.
+ */
+void LtCode::xor_into(char *dst, const char *src, size_t len) {
+   size_t i = 0;
+   for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+      uint64_t a, b;
+      memcpy(&a, dst + i, sizeof(a));
+      memcpy(&b, src + i, sizeof(b));
+      a ^= b;
+      memcpy(dst + i, &a, sizeof(a));
+   }
+   for (; i < len; ++i)
+      dst[i] ^= src[i];
+}
+
+/**
+ * Create an encoder for a source block.
+ * @param block the block data (must outlive the encoder)
+ * @param block_len the block length in bytes
+ * @param symbol_size the symbol size in bytes
+ */
+LtEncoder::LtEncoder(const char *block, size_t block_len, size_t symbol_size)
+        : LtCode((uint32_t) ((block_len + symbol_size - 1) / symbol_size), symbol_size), block(block),
+          block_len(block_len) {
+}
+
+/**
+ * Produce an encoded symbol.
+ * @param seed the symbol's seed
+ * @param out receives symbol_size() bytes
+ */
+void LtEncoder::encode(uint32_t seed, char *out) const {
+   std::vector<uint32_t> indices;
+   neighbours(seed, indices);
+
+   memset(out, 0, size);
+   for (uint32_t index : indices) {
+      size_t start = (size_t) index * size;
+      if (start < block_len)
+         xor_into(out, block + start, std::min(size, block_len - start));
+   }
+}
+
+/**
+ * Create a decoder for a source block.
+ * @param block_len the block length in bytes
+ * @param symbol_size the symbol size in bytes
+ */
+LtDecoder::LtDecoder(size_t block_len, size_t symbol_size)
+        : LtCode((uint32_t) ((block_len + symbol_size - 1) / symbol_size), symbol_size) {
+   source.assign((size_t) K * size, 0);
+   known.assign(K, false);
+   waiting.resize(K);
+   known_count = 0;
+   received_count = 0;
+}
+
+/**
+ * Add an encoded symbol.
+ * @param seed the symbol's seed
+ * @param data the symbol_size() bytes of the symbol
+ * @return true once the whole block is recovered
+ */
+bool LtDecoder::add(uint32_t seed, const char *data) {
+   if (complete())
+      return true;
+   ++received_count;
+
+   Symbol symbol;
+   std::vector<uint32_t> indices;
+   neighbours(seed, indices);
+   symbol.data.assign(data, data + size);
+   for (uint32_t index : indices) {
+      if (known[index])
+         xor_into(symbol.data.data(), source.data() + (size_t) index * size, size);
+      else
+         symbol.unknown.push_back(index);
+   }
+
+   if (symbol.unknown.size() == 1) {
+      recover(symbol.unknown[0], symbol.data.data());
+   } else if (symbol.unknown.size() > 1) {
+      for (uint32_t index : symbol.unknown)
+         waiting[index].push_back(buffered.size());
+      buffered.push_back(std::move(symbol));
+   }
+   return complete();
+}
+
+/**
+ * Store a recovered source symbol and peel it out of every buffered symbol, recovering in turn the symbols that are
+ * reduced to a single neighbour.
+ * @param index the source symbol index
+ * @param data its contents
+ */
+void LtDecoder::recover(uint32_t index, const char *data) {
+   std::vector<std::pair<uint32_t, size_t>> ready; // (source symbol, buffered symbol that yields it)
+   memcpy(source.data() + (size_t) index * size, data, size);
+
+   while (true) {
+      known[index] = true;
+      ++known_count;
+
+      for (size_t id : waiting[index]) {
+         Symbol &b = buffered[id];
+         std::vector<uint32_t>::iterator it = std::find(b.unknown.begin(), b.unknown.end(), index);
+         if (it == b.unknown.end())
+            continue;
+         b.unknown.erase(it);
+         xor_into(b.data.data(), source.data() + (size_t) index * size, size);
+         if (b.unknown.size() == 1)
+            ready.emplace_back(b.unknown[0], id);
+      }
+      waiting[index].clear();
+      waiting[index].shrink_to_fit();
+
+      // Next source symbol released by the peeling, if any
+      do {
+         if (ready.empty())
+            return;
+         index = ready.back().first;
+         Symbol &b = buffered[ready.back().second];
+         ready.pop_back();
+         if (!known[index] && b.unknown.size() == 1) {
+            memcpy(source.data() + (size_t) index * size, b.data.data(), size);
+            b.unknown.clear();
+            std::vector<char>().swap(b.data);
+            break;
+         }
+      } while (true);
+   }
+}
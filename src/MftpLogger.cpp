@@ -0,0 +1,206 @@
+/**
+ * MftpLogger.cpp implements a levelled, asynchronous console logger for the transfer hot paths. A record for a disabled
+ * level costs one relaxed load and a compare. Enabled records are stored as fixed-size binary records (a static format
+ * string plus up to MAX_ARGS scalar arguments) in a lock-free bounded ring buffer; a background thread formats them,
+ * colors them like the UDP_Communicator print methods, and writes them in batches.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <chrono>
+
+#include "MftpLogger.h"
+
+/**
+ * @return the process-wide logger, starting its writer thread on first use
+ */
+MftpLogger &MftpLogger::instance() {
+   static MftpLogger logger;
+   return logger;
+}
+
+/**
+ * Initialize the ring buffer and start the writer thread.
+ */
+MftpLogger::MftpLogger() : enqueue_pos(0), dequeue_pos(0), written(0), dropped(0), threshold(INFO),
+                           console_stream(&std::cout), running(true) {
+   for (size_t i = 0; i < RING_SIZE; ++i)
+      ring[i].sequence.store(i, std::memory_order_relaxed);
+   writer = std::thread(&MftpLogger::writer_loop, this);
+}
+
+/**
+ * Stop the writer thread once every queued record has been written.
+ */
+MftpLogger::~MftpLogger() {
+   running.store(false, std::memory_order_release);
+   writer.join();
+}
+
+/**
+ * Translate a level name from the commandline.
+ * @param name one of "none", "error", "warning", "info", "verbose"
+ * @param level set to the matching level
+ * @return false if the name is not a level
+ */
+bool MftpLogger::parse_level(const std::string &name, Level &level) {
+   if (name == "none")
+      level = NONE;
+   else if (name == "error")
+      level = ERROR;
+   else if (name == "warning")
+      level = WARNING;
+   else if (name == "info")
+      level = INFO;
+   else if (name == "verbose")
+      level = VERBOSE;
+   else
+      return false;
+   return true;
+}
+
+/**
+ * Claim a ring slot and copy the record into it.
+ * @param level severity
+ * @param fmt format string literal
+ * @param args packed arguments
+ * @param nargs number of packed arguments
+ */
+void MftpLogger::enqueue(int level, const char *fmt, const Arg *args, int nargs) {
+   size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+   Record *cell;
+
+   while (true) {
+      cell = &ring[pos & (RING_SIZE - 1)];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+      if (diff == 0) {
+         // Slot is free; try to claim it
+         if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+      } else if (diff < 0) {
+         // Ring is full: never block the caller
+         dropped.fetch_add(1, std::memory_order_relaxed);
+         return;
+      } else {
+         pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+   }
+
+   cell->level = (uint8_t) level;
+   cell->nargs = (uint8_t) nargs;
+   cell->fmt = fmt;
+   for (int i = 0; i < nargs; ++i)
+      cell->args[i] = args[i];
+   cell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * Pop the oldest record (writer thread only).
+ * @param out receives a copy of the record
+ * @return false if the ring is empty
+ */
+bool MftpLogger::dequeue(Record &out) {
+   size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+   Record &cell = ring[pos & (RING_SIZE - 1)];
+   size_t seq = cell.sequence.load(std::memory_order_acquire);
+
+   if ((intptr_t) seq - (intptr_t) (pos + 1) < 0)
+      return false;
+
+   out.level = cell.level;
+   out.nargs = cell.nargs;
+   out.fmt = cell.fmt;
+   for (int i = 0; i < cell.nargs; ++i)
+      out.args[i] = cell.args[i];
+
+   dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+   cell.sequence.store(pos + RING_SIZE, std::memory_order_release);
+   return true;
+}
+
+/**
+ * Block until every record enqueued before this call has been written. Used by the synchronous print methods so that
+ * console output stays in order.
+ */
+void MftpLogger::flush() {
+   size_t target = enqueue_pos.load(std::memory_order_acquire);
+   while (written.load(std::memory_order_acquire) < target)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+/**
+ * Substitute each "{}" in the format string with the matching argument.
+ * @param line output string (appended to)
+ * @param record the record to format
+ */
+void MftpLogger::format(std::string &line, const Record &record) {
+   int arg = 0;
+   for (const char *c = record.fmt; *c; ++c) {
+      if (c[0] == '{' && c[1] == '}' && arg < record.nargs) {
+         const Arg &a = record.args[arg++];
+         switch (a.type) {
+            case Arg::SIGNED:
+               line += std::to_string(a.i);
+               break;
+            case Arg::UNSIGNED:
+               line += std::to_string(a.u);
+               break;
+            case Arg::FLOAT:
+               line += std::to_string(a.d);
+               break;
+            case Arg::STRING:
+               line += a.s;
+               break;
+         }
+         ++c;
+      } else {
+         line += *c;
+      }
+   }
+}
+
+/**
+ * Writer thread body: drain the ring, format each record in its level's color, and write the batch with one flush.
+ */
+void MftpLogger::writer_loop() {
+   static const char *colors[] = {"\033[91m", "\033[93m", "\033[36m", "\033[35m"};
+   std::string batch;
+   Record record;
+   uint64_t reported_drops = 0;
+
+   while (true) {
+      bool stopping = !running.load(std::memory_order_acquire);
+      size_t count = 0;
+
+      batch.clear();
+      while (dequeue(record)) {
+         batch += colors[record.level];
+         format(batch, record);
+         batch += "\033[0m\n";
+         ++count;
+      }
+
+      // Report records lost to a full ring
+      uint64_t drops = dropped.load(std::memory_order_relaxed);
+      if (drops != reported_drops) {
+         batch += std::string(colors[WARNING]) + std::to_string(drops - reported_drops) +
+                  " log records dropped (ring buffer full)\033[0m\n";
+         reported_drops = drops;
+      }
+
+      if (!batch.empty()) {
+         console() << batch;
+         console().flush();
+         written.fetch_add(count, std::memory_order_release);
+      } else if (stopping) {
+         break;
+      } else {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+   }
+}
@@ -0,0 +1,119 @@
+/**
+ * MftpOptions.cpp collects the optional "--name=value" switches shared by the Client and Server executables. Switches
+ * may appear anywhere on the commandline; they are consumed and removed from argv so that the positional arguments can
+ * still be read from the end of the array as before.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <cstdlib>
+
+#include "MftpOptions.h"
+#include "UDP_Communicator.h"
+
+/**
+ * Initialize every switch to its default (feature disabled) value.
+ */
+MftpOptions::MftpOptions() {
+   stats_interval_ms = 1000;
+   log_level = MftpLogger::INFO;
+   profile = false;
+   trace_records = MftpTrace::DEFAULT_RECORDS;
+   wire_version = 1;
+   bandwidth_mbps = 100;
+   fanout = 0;
+   peer_repair = false;
+   carousel = 0;
+   carousel_rounds = 1;
+}
+
+/**
+ * Consume all "--name" and "--name=value" switches from the argument array. Positional arguments are compacted to the
+ * front of argv (after argv[0]) and argc is updated to the number of remaining entries.
+ *
+ * @param argc argument count, updated in place
+ * @param argv argument array, compacted in place
+ * @return true if all switches were understood, false (after printing usage) otherwise
+ */
+bool MftpOptions::parse(int &argc, char *argv[]) {
+   int kept = 1;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg(argv[i]);
+
+      // Positional argument, keep it in order
+      if (arg.size() < 3 || arg.compare(0, 2, "--") != 0) {
+         argv[kept++] = argv[i];
+         continue;
+      }
+
+      // Split "--name=value"
+      size_t eq = arg.find('=');
+      std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+      std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+      if (name == "stats" && !value.empty()) {
+         stats_path = value;
+      } else if (name == "stats-interval" && !value.empty()) {
+         stats_interval_ms = atoi(value.c_str());
+      } else if (name == "wire" && (value == "1" || value == "2")) {
+         wire_version = atoi(value.c_str());
+      } else if (name == "bandwidth" && atoi(value.c_str()) > 0) {
+         bandwidth_mbps = atoi(value.c_str());
+      } else if (name == "fanout" && atoi(value.c_str()) > 0) {
+         fanout = atoi(value.c_str());
+      } else if (name == "peer-repair" && value.empty()) {
+         peer_repair = true;
+      } else if (name == "carousel" && atof(value.c_str()) > 1.0) {
+         carousel = atof(value.c_str());
+      } else if (name == "carousel-rounds" && atoi(value.c_str()) > 0) {
+         carousel_rounds = atoi(value.c_str());
+      } else if (name == "group" && !value.empty()) {
+         group = value;
+      } else if (name == "local" && !value.empty()) {
+         local = value;
+      } else if (name == "impair" && !value.empty()) {
+         impair = value;
+      } else if (name == "profile" && value.empty()) {
+         profile = true;
+      } else if (name == "trace" && !value.empty()) {
+         trace_path = value;
+      } else if (name == "trace-records" && strtoull(value.c_str(), nullptr, 10) > 0 &&
+                 strtoull(value.c_str(), nullptr, 10) <= MftpTrace::MAX_RECORDS) {
+         trace_records = strtoull(value.c_str(), nullptr, 10);
+      } else if (name == "log-level" && MftpLogger::parse_level(value, log_level)) {
+         MftpLogger::instance().set_level(log_level);
+      } else {
+         UDP_Communicator::error("Unknown option: " + arg);
+         usage();
+         return false;
+      }
+   }
+
+   argc = kept;
+   return true;
+}
+
+/**
+ * Print the list of supported switches to the console.
+ */
+void MftpOptions::usage() {
+   UDP_Communicator::warning("Options (may be placed anywhere on the commandline):");
+   UDP_Communicator::warning("   --stats=<file.json>        Periodically write a JSON statistics snapshot to <file.json>");
+   UDP_Communicator::warning("   --stats-interval=<ms>      Interval between statistics snapshots (default 1000)");
+   UDP_Communicator::warning("   --wire=<1|2>               Client wire format: 1 legacy (default), 2 v2 header");
+   UDP_Communicator::warning("   --bandwidth=<Mbit/s>       Path bandwidth for socket buffer sizing (default 100)");
+   UDP_Communicator::warning("   --fanout=<k>               Relay tree: send to k servers, each forwarding to k more");
+   UDP_Communicator::warning("   --peer-repair              Servers repair each other's lost packets before the client");
+   UDP_Communicator::warning("   --carousel=<overhead>      Feedback-free fountain-coded stream (eg 1.3 x the file)");
+   UDP_Communicator::warning("   --carousel-rounds=<n>      Carousel passes over the file, new symbols each (default 1)");
+   UDP_Communicator::warning("   --group=<address>          (Server) Join a multicast group to receive a carousel");
+   UDP_Communicator::warning("   --local=<addr>,<addr>,...  (Client) Multipath: send from each local address");
+   UDP_Communicator::warning("   --impair=<addr>:<loss>[:ms] (Server) Loss and delay for packets from <addr>, ...");
+   UDP_Communicator::warning("   --profile                  Report perf counters, syscalls/MiB and per-phase timings");
+   UDP_Communicator::warning("   --trace=<file>             Record every packet event in a binary trace (see TraceReplay)");
+   UDP_Communicator::warning("   --trace-records=<n>        Capacity of the trace ring (default 1048576, at most 2^28)");
+   UDP_Communicator::warning("   --log-level=<level>        Console verbosity: none, error, warning, info (default), verbose");
+}
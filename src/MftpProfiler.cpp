@@ -0,0 +1,157 @@
+/**
+ * MftpProfiler.cpp implements the optional profiling mode for MultiFTP Clients and Servers. It reads hardware and
+ * software performance counters for the transfer thread through perf_event_open (cycles, instructions, cache misses,
+ * context switches), accumulates wall time per transfer phase with scoped timers, and counts the socket system calls
+ * issued by the protocol.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <cstring>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "MftpProfiler.h"
+#include "UDP_Communicator.h"
+
+/**
+ * Create an idle profiler. Counters are opened by start().
+ */
+MftpProfiler::MftpProfiler() {
+   for (int i = 0; i < COUNTER_COUNT; ++i) {
+      counter_fd[i] = -1;
+      counter_value[i] = 0;
+   }
+   for (int i = 0; i < PHASE_COUNT; ++i)
+      phase_time[i] = std::chrono::steady_clock::duration::zero();
+   syscalls = 0;
+   packets = 0;
+   bytes = 0;
+   running = false;
+}
+
+/**
+ * Destructor -- close any open counters.
+ */
+MftpProfiler::~MftpProfiler() {
+   for (int i = 0; i < COUNTER_COUNT; ++i) {
+      if (counter_fd[i] >= 0)
+         close(counter_fd[i]);
+   }
+}
+
+/**
+ * Open a single counter for the calling thread on any CPU. If the kernel refuses to count kernel-mode events
+ * (perf_event_paranoid), retry counting user mode only.
+ * @param type perf event type (PERF_TYPE_HARDWARE or PERF_TYPE_SOFTWARE)
+ * @param config perf event id
+ * @return the counter file descriptor, or -1 if unavailable
+ */
+int MftpProfiler::open_counter(uint32_t type, uint64_t config) {
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = type;
+   attr.config = config;
+   attr.disabled = 1;
+   attr.exclude_hv = 1;
+
+   int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+   if (fd < 0) {
+      attr.exclude_kernel = 1;
+      fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+   }
+   return fd;
+}
+
+/**
+ * Open and enable the counters and start the wall clock. Must be called on the transfer thread, since counters only
+ * follow the thread that opened them. Counters the kernel does not allow are reported as unavailable.
+ */
+void MftpProfiler::start() {
+   counter_fd[CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+   counter_fd[INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+   counter_fd[CACHE_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+   counter_fd[CONTEXT_SWITCHES] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+   for (int i = 0; i < COUNTER_COUNT; ++i) {
+      if (counter_fd[i] >= 0) {
+         ioctl(counter_fd[i], PERF_EVENT_IOC_RESET, 0);
+         ioctl(counter_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+   }
+
+   start_time = std::chrono::steady_clock::now();
+   running = true;
+}
+
+/**
+ * Disable the counters, read their final values and stop the wall clock.
+ */
+void MftpProfiler::stop() {
+   if (!running)
+      return;
+
+   stop_time = std::chrono::steady_clock::now();
+   for (int i = 0; i < COUNTER_COUNT; ++i) {
+      if (counter_fd[i] >= 0) {
+         ioctl(counter_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+         if (read(counter_fd[i], &counter_value[i], sizeof(counter_value[i])) != sizeof(counter_value[i]))
+            counter_value[i] = 0;
+      }
+   }
+   running = false;
+}
+
+/**
+ * Print the profiling report to the terminal (alongside the system report).
+ */
+void MftpProfiler::report() {
+   static const char *counter_names[] = {"CPU Cycles", "Instructions", "Cache Misses", "Context Switches"};
+   static const char *phase_names[] = {"Packetize", "Checksum", "Send", "ACK Wait", "Receive", "Disk Write"};
+
+   stop();
+   double total_us = std::chrono::duration_cast<std::chrono::microseconds>(stop_time - start_time).count();
+   double per_packet = packets ? (double) packets : 1.0;
+   double mib = (double) bytes / 1048576.0;
+
+   UDP_Communicator::warning(" * * * * * * * * * * * * * * * * * * PROFILE REPORT * * * * * * * * * * * * * * * * * * ");
+   UDP_Communicator::warning("                 Packets Profiled                 : " + std::to_string(packets));
+   UDP_Communicator::warning("                 Payload MiB                      : " + std::to_string(mib));
+
+   for (int i = 0; i < COUNTER_COUNT; ++i) {
+      std::string name = std::string(counter_names[i]) + " per Packet";
+      name.resize(33, ' ');
+      if (counter_fd[i] < 0)
+         UDP_Communicator::warning("                 " + name + ": unavailable (perf_event_open refused)");
+      else
+         UDP_Communicator::warning("                 " + name + ": " + std::to_string(counter_value[i] / per_packet));
+   }
+   if (counter_fd[CYCLES] >= 0 && counter_fd[INSTRUCTIONS] >= 0 && counter_value[CYCLES])
+      UDP_Communicator::warning("                 Instructions per Cycle           : " +
+                                std::to_string((double) counter_value[INSTRUCTIONS] / counter_value[CYCLES]));
+
+   UDP_Communicator::warning("                 Socket Syscalls per Packet       : " +
+                             std::to_string(syscalls / per_packet));
+   UDP_Communicator::warning("                 Socket Syscalls per MiB          : " +
+                             std::to_string(mib > 0 ? syscalls / mib : 0.0));
+
+   // Phase breakdown, skipping phases this role never enters
+   for (int i = 0; i < PHASE_COUNT; ++i) {
+      double us = std::chrono::duration_cast<std::chrono::microseconds>(phase_time[i]).count();
+      if (us <= 0)
+         continue;
+      std::string name = std::string(phase_names[i]) + " (ms, % of wall)";
+      name.resize(33, ' ');
+      UDP_Communicator::warning("                 " + name + ": " + std::to_string(us / 1000) + ", " +
+                                std::to_string(total_us > 0 ? 100 * us / total_us : 0.0));
+   }
+   UDP_Communicator::warning(" * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *  ");
+}
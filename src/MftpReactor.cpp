@@ -0,0 +1,228 @@
+/**
+ * MftpReactor.cpp implements the single-threaded event loop that drives asynchronous transfers: epoll for the
+ * sockets, and a timer wheel behind a timerfd.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MftpReactor.h"
+#include "UDP_Communicator.h"
+
+/**
+ * Create the epoll instance and its timerfd.
+ */
+MftpReactor::MftpReactor() : stopped(false), in_loop(false), timers(now_us()), loop_us(0),
+                             timer_fd_us(MftpTimerWheel::NEVER) {
+   epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if (epoll_fd < 0 || timer_fd < 0) {
+      UDP_Communicator::error("Unable to create the event loop: " + std::string(strerror(errno)));
+      return;
+   }
+
+   struct epoll_event event;
+   bzero(&event, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.fd = timer_fd;
+   epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+}
+
+/**
+ * Destructor -- closes the epoll instance and the timerfd (watched sockets belong to the caller).
+ */
+MftpReactor::~MftpReactor() {
+   if (timer_fd >= 0)
+      close(timer_fd);
+   if (epoll_fd >= 0)
+      close(epoll_fd);
+}
+
+/**
+ * Call back whenever a socket is readable (level-triggered: until the pending data is read).
+ * @param fd the socket
+ * @param on_readable the callback
+ * @return false if epoll refused the descriptor
+ */
+bool MftpReactor::watch(int fd, Callback on_readable) {
+   struct epoll_event event;
+   bzero(&event, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.fd = fd;
+   int op = watched.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+   if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+      UDP_Communicator::error("Unable to watch socket " + std::to_string(fd) + ": " + std::string(strerror(errno)));
+      return false;
+   }
+   watched[fd] = on_readable;
+   return true;
+}
+
+/**
+ * Stop watching a socket. Must be called before the socket is closed.
+ * @param fd the socket
+ */
+void MftpReactor::unwatch(int fd) {
+   if (watched.erase(fd))
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+/**
+ * Call back once after a delay. In a callback, the delay counts from the clock read of the current loop iteration.
+ * @param delay_us the delay in microseconds
+ * @param on_expiry the callback
+ * @return the timer, for cancel()
+ */
+MftpReactor::TimerId MftpReactor::schedule(uint64_t delay_us, Callback on_expiry) {
+   uint32_t index;
+   if (free_slots.empty()) {
+      index = (uint32_t) timer_slots.size();
+      timer_slots.emplace_back();
+      timer_slots.back().generation = 0;
+   } else {
+      index = free_slots.back();
+      free_slots.pop_back();
+   }
+
+   Timer &slot = timer_slots[index];
+   if (++slot.generation == 0)
+      slot.generation = 1;
+   TimerId timer = (uint64_t) slot.generation << 32 | index;
+   uint64_t expiry = (in_loop ? loop_us : now_us()) + delay_us;
+   slot.wheel_timer = timers.arm(expiry, timer);
+   slot.active = true;
+   slot.callback = std::move(on_expiry);
+
+   // The timerfd is re-armed after every loop iteration; outside one, wake up the loop for an earlier timer now
+   if (!in_loop && expiry < timer_fd_us)
+      arm_timer_fd();
+   return timer;
+}
+
+/**
+ * Cancel a timer that has not fired yet (cancelling a fired or unknown timer does nothing).
+ * @param timer the timer returned by schedule()
+ */
+void MftpReactor::cancel(TimerId timer) {
+   uint32_t index = (uint32_t) timer;
+   if (index >= timer_slots.size() || !timer_slots[index].active ||
+       timer_slots[index].generation != (uint32_t) (timer >> 32))
+      return;
+
+   // A timer already due in the batch being fired is no longer in the wheel: it is skipped as inactive
+   Timer &slot = timer_slots[index];
+   timers.cancel(slot.wheel_timer);
+   slot.active = false;
+   slot.callback = nullptr;
+   free_slots.push_back(index);
+}
+
+/**
+ * Run the loop until stop() is called or there is nothing left to wait for.
+ */
+void MftpReactor::run() {
+   stopped = false;
+   while (!stopped && !idle())
+      run_once(-1);
+}
+
+/**
+ * Wait for events once and run their callbacks.
+ * @param max_wait_ms the longest wait in milliseconds (-1: until an event or timer)
+ * @return false if the wait failed
+ */
+bool MftpReactor::run_once(int max_wait_ms) {
+   struct epoll_event events[MAX_EVENTS];
+   int n = epoll_wait(epoll_fd, events, MAX_EVENTS, max_wait_ms);
+   if (n < 0)
+      return errno == EINTR;
+
+   // The one clock read of this iteration
+   loop_us = now_us();
+   in_loop = true;
+
+   for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == timer_fd) {
+         uint64_t expirations;
+         if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+            in_loop = false;
+            return false;
+         }
+         continue;
+      }
+
+      // The socket may have been unwatched by an earlier callback of this round; copy the callback, as it may
+      // unwatch its own socket
+      std::unordered_map<int, Callback>::iterator it = watched.find(fd);
+      if (it != watched.end()) {
+         Callback callback = it->second;
+         callback();
+      }
+   }
+
+   // Timers are checked on every round, so that a busy socket cannot delay them
+   fire_timers();
+   in_loop = false;
+   arm_timer_fd();
+   return true;
+}
+
+/**
+ * Run the callbacks of every timer due at the clock read of this iteration, as one batch.
+ */
+void MftpReactor::fire_timers() {
+   expired.clear();
+   timers.advance(loop_us, expired);
+   for (TimerId timer : expired) {
+      // Skip the timers cancelled by an earlier callback of the batch; free the slot before the callback reuses it
+      uint32_t index = (uint32_t) timer;
+      Timer &slot = timer_slots[index];
+      if (!slot.active || slot.generation != (uint32_t) (timer >> 32))
+         continue;
+      Callback callback = std::move(slot.callback);
+      slot.active = false;
+      slot.callback = nullptr;
+      free_slots.push_back(index);
+      callback();
+   }
+}
+
+/**
+ * Arm the timerfd, at an absolute time, for the next time the timer wheel has work (or disarm it when no timer is
+ * left).
+ */
+void MftpReactor::arm_timer_fd() {
+   uint64_t next = timers.next_visit();
+   if (next == timer_fd_us)
+      return;
+
+   struct itimerspec spec;
+   bzero(&spec, sizeof(spec));
+   if (next != MftpTimerWheel::NEVER) {
+      spec.it_value.tv_sec = next / 1000000;
+      spec.it_value.tv_nsec = (next % 1000000) * 1000;
+   }
+   timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+   timer_fd_us = next;
+}
+
+/**
+ * The monotonic clock (the timerfd's clock) in microseconds.
+ */
+uint64_t MftpReactor::now_us() {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,152 @@
+/**
+ * MftpRelay.cpp implements the forwarding side of relay-tree distribution: a bounded queue filled by the receiving
+ * server, drained by a thread (or on the server's event loop) that sends the stream on to the server's children
+ * through an MftpClient.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include "MftpRelay.h"
+#include "MftpAsync.h"
+
+/**
+ * Start relaying to a subtree. The relay thread immediately runs the handshake (and, for deeper trees, the relay
+ * setup) with the children, while the server keeps queueing data.
+ *
+ * @param subtree the servers below this one in breadth-first order; the first `fanout` are its children
+ * @param fanout the tree fan-out
+ * @param peer_repair let the children repair each other's losses, as our own client asked of us
+ */
+MftpRelay::MftpRelay(const std::vector<sockaddr_in> &subtree, uint16_t fanout, bool peer_repair)
+        : subtree(subtree), fanout(fanout), peer_repair(peer_repair), setup_failed(false), forwarding(true),
+          queue(QUEUE_BYTES), loop(nullptr), done_timer(0) {
+   worker = std::thread(&MftpRelay::run, this);
+}
+
+/**
+ * Start relaying to a subtree from an event loop: the handshake with the children starts on the loop, while the server
+ * keeps queueing data, and the queue is forwarded once it has completed.
+ *
+ * @param subtree the servers below this one in breadth-first order; the first `fanout` are its children
+ * @param fanout the tree fan-out
+ * @param peer_repair let the children repair each other's losses, as our own client asked of us
+ * @param loop the event loop that drives the server
+ * @param transport the server's network
+ */
+MftpRelay::MftpRelay(const std::vector<sockaddr_in> &subtree, uint16_t fanout, bool peer_repair, MftpEventLoop &loop,
+                     MftpTransport &transport)
+        : subtree(subtree), fanout(fanout), peer_repair(peer_repair), setup_failed(false), forwarding(true),
+          queue(QUEUE_BYTES), loop(&loop), done_timer(0) {
+   std::string no_log;
+   client.reset(new MftpClient(subtree, no_log, 0, false, 0, transport));
+   client->set_fanout(fanout);
+   if (peer_repair)
+      client->enable_peer_repair();
+
+   handshake.reset(new MftpAsyncHandshake(loop, *client));
+   handshake->on_complete(std::bind(&MftpRelay::handshaken, this, std::placeholders::_1));
+   if (!handshake->start(BANDWIDTH_MBPS)) {
+      setup_failed = true;
+      forwarded();
+   }
+}
+
+/**
+ * Destructor -- finish forwarding whatever was queued (on an event loop, the forwarding is abandoned if it has not
+ * finished).
+ */
+MftpRelay::~MftpRelay() {
+   queue.close();
+   if (worker.joinable())
+      worker.join();
+   if (loop)
+      loop->cancel(done_timer);
+}
+
+/**
+ * Queue a payload for forwarding.
+ * @param data the payload
+ * @param len the payload length
+ * @return false if the queue is full; the caller must not acknowledge the packet
+ */
+bool MftpRelay::offer(const char *data, size_t len) {
+   if (setup_failed)
+      return true;
+   if (!queue.offer(data, len))
+      return false;
+   if (sender)
+      sender->resume();
+   return true;
+}
+
+/**
+ * Signal the end of the stream. The relay thread is waited for until the children have received everything that was
+ * queued; on an event loop, the forwarding goes on after returning, until done().
+ */
+void MftpRelay::finish() {
+   queue.close();
+   if (worker.joinable())
+      worker.join();
+   if (sender)
+      sender->resume();
+}
+
+/**
+ * Relay thread: send the queued stream to the children, then close their connections. If the relay tree below us
+ * cannot be set up, the stream is discarded (so that the upstream transfer is not stalled) and failed() reports it.
+ */
+void MftpRelay::run() {
+   std::string no_log;
+   MftpClient client(subtree, no_log, 0, false, 0);
+   client.set_fanout(fanout);
+   if (peer_repair)
+      client.enable_peer_repair();
+
+   std::vector<std::string> chunks;
+   if (!client.handshake(BANDWIDTH_MBPS) && client.relays()) {
+      setup_failed = true;
+      while (queue.take_all(chunks))
+         ;
+      return;
+   }
+   while (queue.take_all(chunks))
+      for (const std::string &chunk : chunks)
+         client.rdt_send_block(chunk.data(), chunk.size());
+   client.shutdown();
+}
+
+/**
+ * Event loop: the handshake with the children has completed. Forward the queue to them, or discard the stream if the
+ * relay tree below us could not be set up.
+ * @param negotiated the handshake's result
+ */
+void MftpRelay::handshaken(bool negotiated) {
+   if (!negotiated && client->relays()) {
+      setup_failed = true;
+      forwarded();
+      return;
+   }
+
+   sender.reset(new MftpAsyncSender(*loop, *client));
+   sender->on_complete([this](bool) { forwarded(); });
+   if (!sender->start([this](char *buffer, size_t len) { return queue.read(buffer, len); })) {
+      setup_failed = true;
+      forwarded();
+   }
+}
+
+/**
+ * Event loop: the stream is forwarded (or discarded). The completion callback runs from the loop, as the server may
+ * delete the relay.
+ */
+void MftpRelay::forwarded() {
+   forwarding = false;
+   done_timer = loop->schedule(0, [this] {
+      done_timer = 0;
+      if (done_callback)
+         done_callback();
+   });
+}
@@ -10,6 +10,11 @@
  * Unauthorized copying of this file, via any medium is strictly prohibited.
  */
 
+#include <algorithm>
+#include <thread>
+
+#include <arpa/inet.h>
+
 #include "MftpServer.h"
 
 /**
@@ -21,14 +26,33 @@
  * @param verbose switch to enable verbose terminal output
  * @param loss_probability float value 0 < loss_probability < 1 indicating the probability that any given packet shall
  *         be artificially "lost" by this server.
+ * @param transport the network the server receives from (the real network, or a simulated host of MftpSimNet)
  */
-MftpServer::MftpServer(std::string &file_path, std::string &logfile, int port, bool verbose, float loss_probability) {
+MftpServer::MftpServer(std::string &file_path, std::string &logfile, int port, bool verbose, float loss_probability,
+                       MftpTransport &transport) : stats("server") {
+   this->transport = &transport;
+
    // Counters initialization
    seq_num = 0;
-   ack_num = 1;
    loss_count = 0;
    packet_count = 0;
    bytes_written = 0;
+   features = WireCapabilities::FEATURE_RELAY | WireCapabilities::FEATURE_PEER_REPAIR;
+   upstream_features = 0;
+   relay = nullptr;
+   event_loop = nullptr;
+   stream = nullptr;
+   ack_sent = false;
+   repairs_served = 0;
+   repairs_received = 0;
+   gap_us = 0;
+   gap_dev_us = 0;
+   repair_timer_armed = false;
+   nacked_offset = UINT64_MAX;
+   carousel_blocks_done = 0;
+   carousel_symbols = 0;
+   carousel_source_symbols = 0;
+   carousel_used_symbols = 0;
 
    // Probabilistic initialization
    srand(getpid() * getpid() * std::time(nullptr));
@@ -38,97 +62,733 @@ MftpServer::MftpServer(std::string &file_path, std::string &logfile, int port, b
    remote_sock_addr = new sockaddr_in;
    bzero((char *) remote_sock_addr, sizeof(*remote_sock_addr));
    inbound_socket = create_bound_UDP_socket(port);
+   local_port = port;
 
    // Files and debug init
    filename = file_path;
    log = logfile;
    debug = verbose;
+   if (debug)
+      logger.set_level(MftpLogger::VERBOSE);
+
+   // The single remote host of a server is the client
+   stats.add_host("client");
 }
 
 /**
  * System destructor.
  */
 MftpServer::~MftpServer() {
-   free(remote_sock_addr);
+   delete relay;
+   delete stream;
+   delete remote_sock_addr;
+}
+
+/**
+ * Start writing periodic JSON statistics snapshots while the transfer runs.
+ * @param path the snapshot file
+ * @param interval_ms time between snapshots in milliseconds
+ */
+void MftpServer::enable_stats(const std::string &path, uint32_t interval_ms) {
+   stats.start_export(path, interval_ms);
+}
+
+/**
+ * Record every data packet received, dropped and acknowledged in a binary trace (see MftpTrace).
+ * @param path the trace file
+ * @param records the capacity of the trace ring, in records
+ * @return false if the trace file could not be created
+ */
+bool MftpServer::enable_trace(const std::string &path, uint64_t records) {
+   return open_trace(path, records, MftpTrace::SERVER, local_port);
+}
+
+/**
+ * Impair the packets from given source addresses differently from the configured loss probability, eg to give each
+ * interface of a multipath client its own loss rate and delay.
+ * @param spec comma-separated "address:loss_probability[:delay_ms]" entries (eg "127.0.0.2:0.1:2,127.0.0.3:0")
+ * @return false if an entry is invalid
+ */
+bool MftpServer::set_impairments(const std::string &spec) {
+   size_t start = 0;
+   while (start <= spec.size()) {
+      size_t comma = std::min(spec.find(',', start), spec.size());
+      std::string entry = spec.substr(start, comma - start);
+      size_t colon = entry.find(':');
+      size_t delay_colon = colon == std::string::npos ? colon : entry.find(':', colon + 1);
+
+      SourceImpairment impairment;
+      if (colon == std::string::npos ||
+          inet_pton(AF_INET, entry.substr(0, colon).c_str(), &impairment.source) != 1) {
+         error("Invalid impairment (expected address:loss[:delay_ms]): " + entry);
+         return false;
+      }
+      std::string loss = entry.substr(colon + 1, delay_colon == std::string::npos ? std::string::npos :
+                                                  delay_colon - colon - 1);
+      impairment.loss_probability = std::roundf(atof(loss.c_str()) * 10000);
+      impairment.delay_us = delay_colon == std::string::npos ? 0 :
+                            (uint32_t) (atof(entry.substr(delay_colon + 1).c_str()) * 1000);
+      impairments.push_back(impairment);
+      start = comma + 1;
+   }
+   return true;
+}
+
+/**
+ * Receive a carousel sent to a multicast group. The server socket is re-created so that several servers on this host
+ * can share the group's port.
+ * @param group the IPv4 multicast group address
+ * @param port the group's port
+ * @return true if the group was joined
+ */
+bool MftpServer::join_group(const std::string &group, int port) {
+   struct ip_mreq membership;
+   bzero(&membership, sizeof(membership));
+   if (inet_aton(group.c_str(), &membership.imr_multiaddr) == 0 ||
+       !IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr))) {
+      error("Not a multicast group address: " + group);
+      return false;
+   }
+   membership.imr_interface.s_addr = htonl(INADDR_ANY);
+
+   transport->close_socket(inbound_socket);
+   inbound_socket = create_bound_UDP_socket(port, true);
+   if (transport->set_option(inbound_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+      error("Unable to join multicast group " + group);
+      return false;
+   }
+   info("Joined multicast group " + group);
+   return true;
 }
 
 /**
  * Reliable data transfer Protocol receive component implementation. Receives packets from a remote host, processes
  * them for validity based on sequence number, checksum, and probabilistic loss. If valid, ACKs packet and writes data
- * to disk, otherwise, drops packet.
+ * to disk (or to stdout when the file name is "-"), otherwise, drops packet.
  */
 void MftpServer::rdt_receive() {
-   // Initialize socket and output file
-   int sockfd = inbound_socket;
-   std::ofstream fd(filename, std::ios_base::binary);
+   // Read packets until we get a FIN packet indicating the client is closing the connection. While a timer is pending
+   // (held-back packets, or the repair timer), poll the socket instead of blocking, so that it fires on time.
+   begin_receive();
+   while (true) {
+      if (!timer_pending()) {
+         if (!receive_packet(0))
+            break;
+         continue;
+      }
+      if (!receive_packet(MSG_DONTWAIT) || !run_timers())
+         break;
+      if (timer_pending())
+         std::this_thread::sleep_for(std::chrono::microseconds(std::min(timer_in_us(), (uint64_t) TIMER_POLL_US)));
+   }
+   end_receive();
+}
 
-   // Initialize remote client address struct
-   struct sockaddr_in cli_addr;
-   bzero(&cli_addr, sizeof(cli_addr));
-   socklen_t length = sizeof(*remote_sock_addr);
+/**
+ * Open the output file (or stream) and start the transfer. The packets are then handled by receive_packet(), and the
+ * transfer is closed by end_receive().
+ */
+void MftpServer::begin_receive() {
+   if (filename == "-")
+      stream = new MftpStreamWriter(STDOUT_FILENO);
+   else
+      out_file.open(filename, std::ios_base::binary);
 
    // Write a timepoint to note experiment start time
    local_time_logs.emplace_back(LogItem());
+   ack_sent = false;
+   gap_us = 0;
+   gap_dev_us = 0;
+   repair_timer_armed = false;
+   nacked_offset = UINT64_MAX;
+}
 
-   // Read packets until we get a FIN packet indicating the client is closing the connection
-   while (true) {
-      bzero(in_buffer, MSG_LEN);
-      int n = recvfrom(sockfd, (char *) in_buffer, MSG_LEN, 0, (struct sockaddr *) &*remote_sock_addr, &length);
+/**
+ * Receive and handle one packet. A packet from a source with an impairment delay is held back, and handled by
+ * run_timers() once the delay has passed.
+ * @param flags recvfrom() flags (MSG_DONTWAIT when the caller waits for the socket itself, eg on an event loop)
+ * @return false once the transfer has ended (FIN received or carousel decoded)
+ */
+bool MftpServer::receive_packet(int flags) {
+   struct sockaddr_in sender;
+   bzero(&sender, sizeof(sender));
 
-      if (n > 0) {
-         // We have received a Close-Connection packet; Run a system report to console and exit
-         if (decode_packet_type() == FIN) {
-            system_report();
-            break;
-         }
+   int n;
+   {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::RECEIVE);
+      n = transport->receive_from(inbound_socket, (char *) in_buffer, MSG_LEN, flags, &sender);
+      if (profiler)
+         profiler->count_syscalls();
+   }
+   if (n <= 0)
+      return true;
 
-         // We have received another type of packet, examine for validity
-         if (valid_seq_num() && valid_checksum() && valid_data_pkt_type() && probability_not_dropped()) {
-            // Write the data
-            fd.write(in_buffer + 8, n - 8);
-            bytes_written += n - 8;
-
-            // ACK the packet
-            bzero(out_buffer, MSG_LEN);
-            encode_packet_type(ACK);
-            encode_seq_num(ack_num);
-            sendto(sockfd, out_buffer, 8, 0, (const struct sockaddr *) &*remote_sock_addr, length);
-
-            // Report to the terminal if we've received a multiple of 1 MiB of data (progress report)
-            if(bytes_written % 1048576 < n && seq_num > 2)
-               info(std::to_string(bytes_written / 1000000) + " MiB received.");
-
-            // Update ack, sequence number for communication, and packet count for system reports
-            ++ack_num;
-            ++seq_num;
-            ++packet_count;
-         }
+   for (const SourceImpairment &impairment : impairments) {
+      if (impairment.delay_us > 0 && impairment.source.s_addr == sender.sin_addr.s_addr) {
+         HeldPacket &held = held_packets.emplace(transport->now() + std::chrono::microseconds(impairment.delay_us),
+                                                 HeldPacket())->second;
+         held.sender = sender;
+         held.data.assign(in_buffer, in_buffer + n);
+         return true;
+      }
+   }
+   return handle_packet(sender, n);
+}
+
+/**
+ * Run the timers that are due: handle the held-back packets whose impairment delay has passed, in the order they are
+ * due, and ask our peers for the next packet if it is late.
+ * @return false once the transfer has ended
+ */
+bool MftpServer::run_timers() {
+   if (repair_timer_armed && repair_due <= transport->now()) {
+      repair_timer_armed = false;
+      request_repair();
+   }
+   while (!held_packets.empty() && held_packets.begin()->first <= transport->now()) {
+      std::multimap<MftpTransport::TimePoint, HeldPacket>::iterator it = held_packets.begin();
+      sockaddr_in sender = it->second.sender;
+      int n = (int) it->second.data.size();
+      memcpy(in_buffer, it->second.data.data(), n);
+      held_packets.erase(it);
+      if (!handle_packet(sender, n))
+         return false;
+   }
+   return true;
+}
+
+/**
+ * Time until the next timer is due (see run_timers()).
+ * @return microseconds (0 if one is due, UINT64_MAX if no timer is pending)
+ */
+uint64_t MftpServer::timer_in_us() {
+   if (!timer_pending())
+      return UINT64_MAX;
+   MftpTransport::TimePoint now = transport->now();
+   MftpTransport::TimePoint due = held_packets.empty() ? repair_due : held_packets.begin()->first;
+   if (repair_timer_armed && repair_due < due)
+      due = repair_due;
+   return due <= now ? 0 : std::chrono::duration_cast<std::chrono::microseconds>(due - now).count();
+}
+
+/**
+ * Handle a packet in the input buffer.
+ * @param sender the host it came from
+ * @param n its length
+ * @return false once the transfer has ended (FIN received or carousel decoded)
+ */
+bool MftpServer::handle_packet(const sockaddr_in &sender, int n) {
+   // Replies to the client go to remote_sock_addr; the latest sender may also be a peer
+   int sockfd = inbound_socket;
+
+   // Statistics: the ACK-to-next-packet time is the RTT as seen from the server
+   HostStats &client = stats.host(0);
+
+   std::chrono::steady_clock::time_point received = transport->now();
+   stats.add(stats.packets_received);
+
+   // Each packet is answered in the wire format it arrived in. The legacy checksum covers the whole buffer,
+   // so zero the bytes that were not received.
+   wire_version = WireHeaderV2View(in_buffer).is_v2() ? 2 : 1;
+   header_len = wire_version == 2 ? WireHeaderV2View::SIZE : LEGACY_HEADER_LEN;
+   if (wire_version != 2)
+      bzero(in_buffer + n, MSG_LEN - n);
+
+   // Repair requests come from our peers, as do repairs; everything else comes from our client
+   if (handle_nack(sender, n))
+      return true;
+   bool repair = wire_version == 2 && (WireHeaderV2View(in_buffer).flags() & WireHeaderV2::FLAG_PEER_REPAIR);
+   if (!repair)
+      *remote_sock_addr = sender;
+
+   // Handshake and path MTU probes
+   if (handle_control(sockfd, n))
+      return true;
+
+   // Carousel symbols are never acknowledged; leave as soon as the whole file is decoded
+   if (decode_packet_type() == CAROUSEL && wire_version == 2) {
+      if (stream) {
+         error("Carousel transfers are decoded out of order and need an output file, not a stream");
+         return false;
+      }
+      if (valid_session() && valid_checksum(n) && probability_not_dropped(n) && receive_symbol(out_file)) {
+         system_report();
+         return false;
+      }
+      return true;
+   }
+
+   // We have received a Close-Connection packet; Run a system report to console and exit
+   if (decode_packet_type() == FIN && valid_session()) {
+      if (!carousel_decoded.empty())
+         error("Carousel ended before the file could be decoded: " + std::to_string(carousel_blocks_done) +
+               " of " + std::to_string(carousel_decoded.size()) + " blocks");
+      system_report();
+      return false;
+   }
+
+   // We have received another type of packet, examine for validity
+   if (valid_seq_num() && valid_checksum(n) && valid_data_pkt_type() && probability_not_dropped(n)) {
+      size_t payload_len = wire_version == 2 ? WireHeaderV2View(in_buffer).payload_len() : n - header_len;
+
+      // Relay tree and output stream: if the queue for our children or for the stream is full, do not accept
+      // the packet. The sender holds it until they have caught up; a v2 sender is told so and probes less often.
+      if ((relay && !relay->accepts(payload_len)) || (stream && !stream->accepts(payload_len))) {
+         logger.log(MftpLogger::VERBOSE, "Output queue full, withholding ACK for offset {}", bytes_written);
+         stats.add(stats.receiver_stalls);
+         repair_timer_armed = false; // The packet arrived; we are not ready for it
+         trace_packet(MftpTrace::DROP, sender, n, MftpTrace::BACKPRESSURE);
+         if (wire_version == 2)
+            send_ack(sockfd, WireHeaderV2::FLAG_BACKPRESSURE);
+         return true;
+      }
+      trace_packet(MftpTrace::RECEIVE, sender, n, repair ? MftpTrace::REPAIRED : 0);
+      if (relay)
+         relay->offer(in_buffer + header_len, payload_len);
+
+      // Write the data
+      {
+         MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::DISK_WRITE);
+         if (stream)
+            stream->offer(in_buffer + header_len, payload_len);
+         else
+            out_file.write(in_buffer + header_len, payload_len);
+      }
+      bytes_written += payload_len;
+      if (!peers.empty())
+         cache_packet(payload_len);
+      if (repair)
+         ++repairs_received;
+      if (profiler)
+         profiler->count_packet(payload_len);
+      stats.add(stats.payload_bytes, payload_len);
+      if (ack_sent) {
+         uint64_t gap = std::chrono::duration_cast<std::chrono::microseconds>(received - last_ack_sent).count();
+         client.rtt.record(gap);
+         update_packet_gap(gap);
       }
+
+      // Update sequence number for communication, and packet count for system reports, then ACK the packet
+      ++seq_num;
+      ++packet_count;
+      send_ack(sockfd, repair ? WireHeaderV2::FLAG_PEER_REPAIR : 0);
+      last_ack_sent = transport->now();
+      ack_sent = true;
+      client.ack_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(last_ack_sent -
+                                                                                     received).count());
+      stats.add(client.acks);
+      stats.add(stats.packets_sent);
+      arm_repair_timer();
+
+      // Report to the terminal if we've received a multiple of 1 MiB of data (progress report)
+      if(bytes_written % 1048576 < payload_len && seq_num > 2)
+         logger.log(MftpLogger::INFO, "{} MiB received.", bytes_written / 1000000);
+   }
+   // The client retransmitted a packet we already have, so our ACK was lost: ACK it again
+   else if (duplicate_packet(n)) {
+      trace_packet(MftpTrace::DUPLICATE, sender, n, 0);
+      send_ack(sockfd, 0);
+      arm_repair_timer();
    }
+   return true;
+}
+
+/**
+ * End the input of our relay, once the transfer has ended. A relay on the event loop goes on forwarding what it has
+ * queued: the callback runs once it is done, and end_receive() must only be called then.
+ * @param on_drained called from the event loop once the relay is done (nullptr: no longer call back)
+ * @return true if the relay is still forwarding and on_drained will be called
+ */
+bool MftpServer::drain_relay(MftpEventLoop::Callback on_drained) {
+   if (!relay || !event_loop)
+      return false;
+   relay->finish();
+   bool forwarding = !relay->done();
+   relay->on_done(forwarding ? on_drained : nullptr);
+   return forwarding;
+}
+
+/**
+ * End the transfer: close the file and socket, and wait until the stream and our subtree have the whole file.
+ * With a relay on the event loop, call drain_relay() first.
+ * @return false if the output could not be written, or the relay could not reach our subtree
+ */
+bool MftpServer::end_receive() {
+   bool written = !out_file.fail();
 
-   // Close the file and socket and exit
-   fd.close();
-   close(sockfd);
+   // Close the file and socket, wait until the stream and our subtree have the whole file, write the final statistics
+   // snapshot and exit
+   out_file.close();
+   transport->close_socket(inbound_socket);
+   if (stream) {
+      stream->finish();
+      written = !stream->failed();
+      delete stream;
+      stream = nullptr;
+   }
+   if (relay) {
+      relay->finish();
+      if (relay->failed()) {
+         error("Relay tree: our subtree did not receive the file");
+         written = false;
+      }
+      delete relay;
+      relay = nullptr;
+   }
+   stats.stop_export();
+   return written;
 }
 
 /**
- * Determine if the sequence number of the packet in the input buffer is the next one we want to receive
+ * Determine if the sequence number of the packet in the input buffer is the next one we want to receive. For v2
+ * packets, the byte offset must be the next byte we expect, within the current session.
  * @return true if this packet is the one we are waiting for, false otherwise (eg duplicate or out-of-order packet)
  */
 bool MftpServer::valid_seq_num() {
+   if (wire_version == 2)
+      return valid_session() && WireHeaderV2View(in_buffer).offset() == bytes_written;
    if (decode_seq_num() == seq_num)
       return true;
    return false;
 }
 
+/**
+ * Determine whether a v2 packet belongs to the current session. The session is adopted from the first packet at
+ * offset 0, so that stale packets of an earlier transfer are ignored. Legacy packets carry no session.
+ * @return true if the packet in the input buffer belongs to this transfer
+ */
+bool MftpServer::valid_session() {
+   if (wire_version != 2)
+      return true;
+
+   WireHeaderV2View header(in_buffer);
+   if (session_id == 0 && ((header.offset() == 0 && (header.type() == DATA_PACKET || header.type() == SYN)) ||
+                           header.type() == CAROUSEL))
+      session_id = header.session_id();
+   return header.session_id() == session_id;
+}
+
+/**
+ * Determine if the packet in the input buffer is an intact retransmission of data we have already written.
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if the packet is a duplicate that should be ACKed again
+ */
+bool MftpServer::duplicate_packet(int received_len) {
+   if (decode_packet_type() != DATA_PACKET)
+      return false;
+   if (wire_version == 2) {
+      WireHeaderV2View header(in_buffer);
+      return valid_session() && header.offset() < bytes_written && valid_v2_checksum(received_len);
+   }
+   return decode_seq_num() + 1 == seq_num;
+}
+
+/**
+ * ACK everything received so far, in the wire format of the packet in the input buffer. Legacy ACKs carry the next
+ * expected sequence number; v2 ACKs carry the next expected byte offset.
+ * @param sockfd the bound server socket
+ * @param flags v2 header flags (FLAG_PEER_REPAIR if the data was repaired by a peer)
+ */
+void MftpServer::send_ack(int sockfd, uint16_t flags) {
+   if (wire_version == 2) {
+      encode_v2_header(ACK, flags, bytes_written, 0);
+   } else {
+      bzero(out_buffer, LEGACY_HEADER_LEN);
+      encode_packet_type(ACK);
+      encode_seq_num(seq_num);
+   }
+
+   trace(MftpTrace::ACK_SENT, *remote_sock_addr, seq_num, bytes_written, 0,
+         (flags & WireHeaderV2::FLAG_PEER_REPAIR ? MftpTrace::REPAIRED : 0) |
+         (flags & WireHeaderV2::FLAG_BACKPRESSURE ? MftpTrace::HELD : 0));
+
+   MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::SEND);
+   transport->send_to(sockfd, out_buffer, header_len, *remote_sock_addr);
+   if (profiler)
+      profiler->count_syscalls();
+}
+
+/**
+ * Answer the v2 control packets of the client handshake:
+ *  - SYN: reply with a SYN_ACK advertising our receive buffer, largest segment, features and checksum types. A
+ *    confirming SYN also carries the receive buffer the client sized for the bandwidth-delay product, which is applied
+ *    before replying.
+ *  - PROBE: echo the size of the probe (as the offset of a PROBE_ACK) so the client learns it crossed the path.
+ *  - RELAY_SETUP: add the hosts it lists to our subtree, start relaying after the last part of the list (once per
+ *    transfer), and reply with a RELAY_ACK.
+ *  - PEER_SETUP: adopt the repair peers it lists and reply with a PEER_ACK.
+ *
+ * @param sockfd the bound server socket
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if the packet was a control packet (handled or discarded), false for data/FIN packets
+ */
+bool MftpServer::handle_control(int sockfd, int received_len) {
+   WireHeaderV2View header(in_buffer);
+   if (wire_version != 2 || (header.type() != SYN && header.type() != PROBE && header.type() != RELAY_SETUP &&
+                             header.type() != PEER_SETUP))
+      return false;
+   if (!valid_v2_checksum(received_len) || !valid_session())
+      return true;
+
+   size_t reply_len = WireHeaderV2View::SIZE;
+   if (header.type() == PROBE) {
+      encode_v2_header(PROBE_ACK, 0, received_len, 0);
+   } else if (header.type() == RELAY_SETUP) {
+      if (!receive_relay_setup())
+         return true;
+      encode_v2_header(RELAY_ACK, 0, header.offset(), 0);
+   } else if (header.type() == PEER_SETUP) {
+      WireRelaySetupView setup(header.payload());
+      if (header.payload_len() >= WireRelaySetupView::SIZE &&
+          header.payload_len() >= WireRelaySetupView::length(setup.count())) {
+         peers.assign(setup.count(), sockaddr_in());
+         for (size_t i = 0; i < peers.size(); ++i) {
+            bzero(&peers[i], sizeof(peers[i]));
+            peers[i].sin_family = AF_INET;
+            peers[i].sin_addr.s_addr = setup.host_address(i);
+            peers[i].sin_port = setup.host_port(i);
+         }
+         repair_cache.assign(REPAIR_CACHE_PACKETS, CachedPacket());
+         verbose("Peer repair: " + std::to_string(peers.size()) + " peers");
+      }
+      encode_v2_header(PEER_ACK, 0, 0, 0);
+   } else {
+      WireCapabilitiesView request(header.payload());
+      if ((header.flags() & WireHeaderV2::FLAG_CONFIRM) && header.payload_len() >= WireCapabilitiesView::SIZE) {
+         set_socket_buffer(sockfd, SO_RCVBUF, request.recv_buffer());
+         upstream_features = request.features();
+         verbose("Handshake confirmed: MSS " + std::to_string(request.selected_mss()));
+      }
+
+      int recv_buffer = 0;
+      socklen_t len = sizeof(recv_buffer);
+      transport->get_option(sockfd, SOL_SOCKET, SO_RCVBUF, &recv_buffer, &len);
+
+      WireCapabilitiesView caps(WireHeaderV2View(out_buffer).payload());
+      caps.set_recv_buffer(recv_buffer);
+      caps.set_max_segment(MSG_LEN - WireHeaderV2View::SIZE);
+      caps.set_features(features);
+      caps.set_checksum_types(WireCapabilities::CHECKSUM_LEGACY_BYTES | WireCapabilities::CHECKSUM_V2_WORDS);
+      caps.set_selected_mss(0);
+      encode_v2_header(SYN_ACK, header.flags(), 0, WireCapabilitiesView::SIZE);
+      reply_len += WireCapabilitiesView::SIZE;
+   }
+
+   transport->send_to(sockfd, out_buffer, reply_len, *remote_sock_addr);
+   return true;
+}
+
+/**
+ * Add the hosts listed in the RELAY_SETUP packet in the input buffer to our subtree, and start forwarding to it once
+ * the last part of the list has arrived. The parts arrive in order, each once acknowledged; a part we already have
+ * (our RELAY_ACK was lost) is only acknowledged again.
+ * @return false if the packet is malformed or does not continue the list: it is not acknowledged
+ */
+bool MftpServer::receive_relay_setup() {
+   WireHeaderV2View header(in_buffer);
+   WireRelaySetupView setup(header.payload());
+   if (header.payload_len() < WireRelaySetupView::SIZE || setup.fanout() == 0 ||
+       header.payload_len() < WireRelaySetupView::length(setup.count()) || header.offset() > relay_subtree.size())
+      return false;
+   if (relay || header.offset() < relay_subtree.size())
+      return true;
+
+   for (size_t i = 0; i < setup.count(); ++i) {
+      sockaddr_in host;
+      bzero(&host, sizeof(host));
+      host.sin_family = AF_INET;
+      host.sin_addr.s_addr = setup.host_address(i);
+      host.sin_port = setup.host_port(i);
+      relay_subtree.push_back(host);
+   }
+   if (header.flags() & WireHeaderV2::FLAG_MORE)
+      return true;
+
+   info("Relaying to " + std::to_string(std::min<size_t>(setup.fanout(), relay_subtree.size())) + " children (" +
+        std::to_string(relay_subtree.size()) + " servers downstream)");
+   bool peer_repair = upstream_features & WireCapabilities::FEATURE_PEER_REPAIR;
+   if (event_loop)
+      relay = new MftpRelay(relay_subtree, setup.fanout(), peer_repair, *event_loop, *transport);
+   else
+      relay = new MftpRelay(relay_subtree, setup.fanout(), peer_repair);
+   return true;
+}
+
+/**
+ * Answer a repair request (NACK) from a peer: send the requested packet if it is still cached, or remember the request
+ * if it is for the packet we expect next, and send it when that packet arrives.
+ * @param sender the peer that sent the packet in the input buffer
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if the packet was a NACK (answered or discarded)
+ */
+bool MftpServer::handle_nack(const sockaddr_in &sender, int received_len) {
+   WireHeaderV2View header(in_buffer);
+   if (wire_version != 2 || header.type() != NACK)
+      return false;
+   if (repair_cache.empty() || !valid_v2_checksum(received_len) || !valid_session())
+      return true;
+
+   uint64_t offset = header.offset();
+   for (const CachedPacket &packet : repair_cache) {
+      if (packet.len > 0 && packet.offset == offset) {
+         send_repair(packet, sender);
+         return true;
+      }
+   }
+   if (offset == bytes_written && pending_repairs.size() < MAX_PENDING_REPAIRS)
+      pending_repairs.emplace_back(sender, offset);
+   return true;
+}
+
+/**
+ * Keep a copy of the data packet in the input buffer for our peers, and serve the peers that already asked for it.
+ * @param payload_len the payload length of the packet
+ */
+void MftpServer::cache_packet(size_t payload_len) {
+   CachedPacket &packet = repair_cache[packet_count % repair_cache.size()];
+   packet.offset = WireHeaderV2View(in_buffer).offset();
+   packet.len = payload_len;
+   memcpy(packet.payload, in_buffer + header_len, payload_len);
+
+   for (const std::pair<sockaddr_in, uint64_t> &request : pending_repairs) {
+      if (request.second == packet.offset)
+         send_repair(packet, request.first);
+   }
+   pending_repairs.clear();
+}
+
+/**
+ * Add the carousel symbol in the input buffer to the decoder of its block. A block is written to its place in the file
+ * as soon as it is decoded.
+ * @param fd the output file
+ * @return true once every block of the file is decoded
+ */
+bool MftpServer::receive_symbol(std::ofstream &fd) {
+   WireHeaderV2View header(in_buffer);
+   WireCarouselView symbol(header.payload());
+   if (header.payload_len() <= WireCarouselView::SIZE)
+      return false;
+
+   size_t symbol_size = header.payload_len() - WireCarouselView::SIZE;
+   uint64_t file_size = symbol.file_size();
+   uint64_t offset = header.offset();
+   uint32_t block_bytes = symbol.block_bytes();
+   if (block_bytes == 0 || offset >= file_size || offset % block_bytes != 0)
+      return false;
+   if (carousel_decoded.empty()) {
+      carousel_decoded.assign((file_size + block_bytes - 1) / block_bytes, false);
+      set_socket_buffer(inbound_socket, SO_RCVBUF, CAROUSEL_RECV_BUFFER);
+   }
+
+   size_t block = offset / block_bytes;
+   ++carousel_symbols;
+   trace(MftpTrace::RECEIVE, *remote_sock_addr, symbol.seed(), offset, symbol_size);
+   if (block >= carousel_decoded.size() || carousel_decoded[block])
+      return false;
+
+   size_t block_len = (size_t) std::min<uint64_t>(block_bytes, file_size - offset);
+   std::map<uint64_t, LtDecoder>::iterator it = carousel_blocks.find(offset);
+   if (it == carousel_blocks.end())
+      it = carousel_blocks.emplace(offset, LtDecoder(block_len, symbol_size)).first;
+   if (!it->second.add(symbol.seed(), symbol.symbol()))
+      return false;
+
+   // Block decoded: write it and release the decoder
+   {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::DISK_WRITE);
+      fd.seekp(offset);
+      fd.write(it->second.data(), block_len);
+   }
+   carousel_source_symbols += it->second.source_symbols();
+   carousel_used_symbols += it->second.received();
+   carousel_blocks.erase(it);
+   carousel_decoded[block] = true;
+   ++carousel_blocks_done;
+   ++packet_count;
+   bytes_written += block_len;
+   stats.add(stats.payload_bytes, block_len);
+   if (profiler)
+      profiler->count_packet(block_len);
+   logger.log(MftpLogger::VERBOSE, "Carousel block {} decoded", block);
+
+   return carousel_blocks_done == carousel_decoded.size();
+}
+
+/**
+ * Send a cached packet to a peer that lost it.
+ * @param packet the cached packet
+ * @param peer the peer's server address
+ */
+void MftpServer::send_repair(const CachedPacket &packet, const sockaddr_in &peer) {
+   memcpy(out_buffer + WireHeaderV2View::SIZE, packet.payload, packet.len);
+   encode_v2_header(DATA_PACKET, WireHeaderV2::FLAG_PEER_REPAIR, packet.offset, packet.len);
+   transport->send_to(inbound_socket, out_buffer, WireHeaderV2View::SIZE + packet.len, peer);
+   ++repairs_served;
+   if (profiler)
+      profiler->count_syscalls();
+}
+
+/**
+ * Ask our peers for the packet we expect next (after losing it), so that it can be repaired before the client times
+ * out. Each packet is asked for once.
+ */
+void MftpServer::request_repair() {
+   if (wire_version != 2 || peers.empty() || nacked_offset == bytes_written)
+      return;
+   nacked_offset = bytes_written;
+   encode_v2_header(NACK, 0, bytes_written, 0);
+   for (const sockaddr_in &peer : peers)
+      transport->send_to(inbound_socket, out_buffer, WireHeaderV2View::SIZE, peer);
+   if (profiler)
+      profiler->count_syscalls(peers.size());
+}
+
+/**
+ * Update the smoothed time from our ACK to the client's next packet, and its deviation (with the gains of the
+ * client's RTT estimate).
+ * @param gap_sample the time from our last ACK to the packet just received, in microseconds
+ */
+void MftpServer::update_packet_gap(uint64_t gap_sample) {
+   double deviation = std::abs((double) gap_sample - gap_us);
+   gap_us = gap_us == 0 ? gap_sample : 0.875 * gap_us + 0.125 * gap_sample;
+   gap_dev_us = 0.75 * gap_dev_us + 0.25 * deviation;
+}
+
+/**
+ * After an ACK, wait for the next packet. A stop-and-wait server cannot see a gap in the stream, so with peer repair
+ * the next packet is treated as lost (and asked of our peers) if it has not arrived within the usual ACK-to-packet time
+ * plus two deviations: before the client's retransmission timeout of its RTT plus four deviations.
+ */
+void MftpServer::arm_repair_timer() {
+   if (wire_version != 2 || peers.empty() || gap_us == 0)
+      return;
+   repair_due = transport->now() + std::chrono::microseconds((uint64_t) (gap_us + 2 * gap_dev_us) + 1);
+   repair_timer_armed = true;
+}
+
 /**
  * Call to superclass to compute the checksum of the packet in the input buffer; Compare checksum to the checksum
  * we received from the transmitter.
+ * @param received_len number of bytes returned by recvfrom()
  * @return true if checksum indicates no errors, false if checksum indicates errors
  */
-bool MftpServer::valid_checksum() {
+bool MftpServer::valid_checksum(int received_len) {
+   if (wire_version == 2) {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::CHECKSUM);
+      if (valid_v2_checksum(received_len))
+         return true;
+      logger.log(MftpLogger::ERROR, "invalid checksum");
+      trace_packet(MftpTrace::DROP, *remote_sock_addr, received_len, MftpTrace::CHECKSUM);
+      request_repair();
+      return false;
+   }
+
    // Checksum the input buffer
-   uint16_t checksum = decode_checksum();
+   uint16_t checksum;
+   {
+      MftpProfiler::ScopedPhase phase(profiler, MftpProfiler::CHECKSUM);
+      checksum = decode_checksum();
+   }
 
    // Copy the checksums we received from the sender
    char a = checksum >> 8;
@@ -137,7 +797,8 @@ bool MftpServer::valid_checksum() {
    // Confirm match
    if (in_buffer[4] == a && in_buffer[5] == b)
       return true;
-   error("invalid checksum");
+   logger.log(MftpLogger::ERROR, "invalid checksum");
+   trace_packet(MftpTrace::DROP, *remote_sock_addr, received_len, MftpTrace::CHECKSUM);
    return false;
 }
 
@@ -148,25 +809,64 @@ bool MftpServer::valid_checksum() {
 bool MftpServer::valid_data_pkt_type() {
    if (decode_packet_type() == DATA_PACKET)
       return true;
-   error("Invalid packet type");
+   logger.log(MftpLogger::ERROR, "Invalid packet type");
    return false;
 }
 
 /**
  * Probabilistic loss generator. Compute a random number in the range of 0 - 10000 (resolution: hundreths of one percent)
  * and, if the random number is less than the configured probability percentage, indicate to the caller that this
- * packet should be artifically dropped.
+ * packet should be artifically dropped. A packet from a source with its own impairment uses that loss probability
+ * (its delay was applied when it arrived).
+ * @param received_len number of bytes returned by recvfrom()
  * @return true if packet should be kept, false if packet should be dropped
  */
-bool MftpServer::probability_not_dropped() {
-   if (rand() % 10000 < loss_probability) {
-      error("Packet loss, sequence number = " + std::to_string(decode_seq_num()));
+bool MftpServer::probability_not_dropped(int received_len) {
+   int probability = loss_probability;
+   for (const SourceImpairment &impairment : impairments) {
+      if (impairment.source.s_addr == remote_sock_addr->sin_addr.s_addr)
+         probability = impairment.loss_probability;
+   }
+
+   if (rand() % 10000 < probability) {
+      if (wire_version == 2)
+         logger.log(MftpLogger::ERROR, "Packet loss, offset = {}", WireHeaderV2View(in_buffer).offset());
+      else
+         logger.log(MftpLogger::ERROR, "Packet loss, sequence number = {}", decode_seq_num());
       ++loss_count;
+      stats.add(stats.drops);
+      trace_packet(MftpTrace::DROP, *remote_sock_addr, received_len, MftpTrace::LOSS);
+      request_repair();
       return false;
    }
    return true;
 }
 
+/**
+ * Record the data packet in the input buffer in the trace. Legacy packets carry no offset: a new packet starts at the
+ * bytes written so far, and a duplicate is the packet before it. A carousel symbol is recorded by its seed and symbol
+ * size, as the client sends it and receive_symbol() receives it.
+ * @param event the MftpTrace event (RECEIVE, DUPLICATE or DROP)
+ * @param sender the host the packet came from
+ * @param received_len number of bytes returned by recvfrom()
+ * @param detail the drop reason, or MftpTrace::REPAIRED for a packet sent by a peer
+ */
+void MftpServer::trace_packet(MftpTrace::Event event, const sockaddr_in &sender, int received_len, uint8_t detail) {
+   if (!tracer)
+      return;
+   bool duplicate = event == MftpTrace::DUPLICATE;
+   size_t payload_len = wire_version == 2 ? WireHeaderV2View(in_buffer).payload_len() : received_len - header_len;
+   uint64_t offset = wire_version == 2 ? WireHeaderV2View(in_buffer).offset() :
+                     bytes_written - (duplicate ? payload_len : 0);
+   if (wire_version == 2 && decode_packet_type() == CAROUSEL) {
+      WireCarouselView symbol(WireHeaderV2View(in_buffer).payload());
+      trace(event, sender, symbol.seed(), offset, payload_len > WireCarouselView::SIZE ?
+            payload_len - WireCarouselView::SIZE : 0, detail);
+      return;
+   }
+   trace(event, sender, duplicate ? seq_num - 1 : seq_num, offset, payload_len, detail);
+}
+
 /**
  * Utility method that prints a transfer report to the terminal upon exit with statistics related to the transfer.
  */
@@ -177,5 +877,22 @@ void MftpServer::system_report() {
    warning("              Packets Probabilistically Dropped    : " + std::to_string(loss_count));
    warning("              Local Configured Loss Rate           : " + std::to_string((float) loss_probability / 10000));
    warning("              Local Effective Loss Rate            : " + std::to_string(percentage));
+   if (!carousel_decoded.empty()) {
+      warning("              Carousel Blocks Decoded              : " + std::to_string(carousel_blocks_done) + " / " +
+              std::to_string(carousel_decoded.size()));
+      warning("              Carousel Symbols Received            : " + std::to_string(carousel_symbols));
+      warning("              Symbols Used per Source Symbol       : " +
+              std::to_string(carousel_source_symbols ? (double) carousel_used_symbols / carousel_source_symbols : 0.0));
+   }
+   if (!peers.empty()) {
+      warning("              Packets Repaired by Peers            : " + std::to_string(repairs_received));
+      warning("              Repairs Served to Peers              : " + std::to_string(repairs_served));
+   }
+   if (stats.receiver_stalls.load(std::memory_order_relaxed) > 0)
+      warning("              Packets Refused, Output Queue Full   : " +
+              std::to_string(stats.receiver_stalls.load(std::memory_order_relaxed)));
    warning(" * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * ");
+
+   if (profiler)
+      profiler->report();
 }
\ No newline at end of file
@@ -0,0 +1,350 @@
+/**
+ * MftpSimNet.cpp implements the discrete-event network simulation: the simulated hosts and sockets, the link model
+ * applied to every datagram, and the virtual-time event loop.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "MftpSimNet.h"
+
+/**
+ * Create an empty network.
+ * @param seed seed of the generator behind every loss and jitter draw (the same seed replays the same run)
+ */
+MftpSimNet::MftpSimNet(uint64_t seed) : random(seed), clock_us(0), stopped(false), next_timer(1), sent(0), lost(0),
+                                        overflowed(0) {
+}
+
+/**
+ * Add a host to the network.
+ * @param address the host's address; datagrams sent to it are delivered to its sockets
+ * @param link the host's link to the network core
+ * @return the transport to construct the host's clients and servers with (owned by the network)
+ */
+MftpTransport &MftpSimNet::add_host(const in_addr &address, const MftpLinkModel &link) {
+   hosts.emplace_back(new Host(*this, address, link));
+   host_addresses[address.s_addr] = hosts.back().get();
+   return *hosts.back();
+}
+
+/**
+ * Call back whenever a socket holds datagrams (level-triggered, like MftpReactor::watch()).
+ * @param fd the socket
+ * @param on_readable the callback
+ * @return false if the socket is not open
+ */
+bool MftpSimNet::watch(int fd, Callback on_readable) {
+   Socket *s = socket(fd);
+   if (!s)
+      return false;
+   s->on_readable = on_readable;
+   if (!s->queue.empty() && !s->ready) {
+      s->ready = true;
+      ready.push_back(fd);
+   }
+   return true;
+}
+
+/**
+ * Stop watching a socket.
+ * @param fd the socket
+ */
+void MftpSimNet::unwatch(int fd) {
+   Socket *s = socket(fd);
+   if (s)
+      s->on_readable = nullptr;
+}
+
+/**
+ * Call back once after a delay of virtual time (at least TIMER_SLACK_US).
+ * @param delay_us the delay in microseconds
+ * @param on_expiry the callback
+ * @return the timer, for cancel()
+ */
+MftpSimNet::TimerId MftpSimNet::schedule(uint64_t delay_us, Callback on_expiry) {
+   TimerId timer = next_timer++;
+   timers[timer] = on_expiry;
+
+   Event event;
+   event.timer = timer;
+   events.emplace(clock_us + (delay_us < TIMER_SLACK_US ? TIMER_SLACK_US : delay_us), std::move(event));
+   return timer;
+}
+
+/**
+ * Cancel a timer that has not fired yet (cancelling a fired or unknown timer does nothing).
+ * @param timer the timer returned by schedule()
+ */
+void MftpSimNet::cancel(TimerId timer) {
+   timers.erase(timer);
+}
+
+/**
+ * Run the simulation until stop() is called or no event is left. All the events of one instant are processed
+ * together: datagrams are delivered first, then the watched sockets are called back, then the timers fire (so that an
+ * ACK arriving at the retransmission deadline cancels the retransmission, as on a real event loop).
+ */
+void MftpSimNet::run() {
+   stopped = false;
+   std::vector<TimerId> due;
+   while (!stopped) {
+      // Cancelled timers stay queued: skip them, so that they do not advance the clock
+      while (!events.empty() && events.begin()->second.timer && !timers.count(events.begin()->second.timer))
+         events.erase(events.begin());
+      if (events.empty())
+         break;
+
+      clock_us = events.begin()->first;
+      while (!events.empty() && events.begin()->first == clock_us) {
+         Event event = std::move(events.begin()->second);
+         events.erase(events.begin());
+         if (event.timer)
+            due.push_back(event.timer);
+         else
+            deliver(event);
+      }
+
+      dispatch_readable();
+      for (TimerId timer : due) {
+         std::unordered_map<TimerId, Callback>::iterator it = timers.find(timer);
+         if (it == timers.end())
+            continue;
+         Callback callback = it->second;
+         timers.erase(it);
+         callback();
+         dispatch_readable();
+      }
+      due.clear();
+   }
+}
+
+/**
+ * Look up an open socket.
+ * @param fd the socket
+ * @return the socket, or nullptr if it is unknown or closed (errno is set to EBADF)
+ */
+MftpSimNet::Socket *MftpSimNet::socket(int fd) {
+   if (fd < FIRST_FD || (size_t) (fd - FIRST_FD) >= sockets.size() || !sockets[fd - FIRST_FD].open) {
+      errno = EBADF;
+      return nullptr;
+   }
+   return &sockets[fd - FIRST_FD];
+}
+
+/**
+ * Draw a random event.
+ * @param probability its probability
+ * @return true if it happens
+ */
+bool MftpSimNet::chance(double probability) {
+   return probability > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < probability;
+}
+
+/**
+ * A datagram reaches its destination host: queue it on the socket bound to its address, unless there is none (the
+ * datagram is discarded, as UDP would) or the socket's receive buffer is full (counted as an overflow).
+ * @param event the datagram's arrival
+ */
+void MftpSimNet::deliver(Event &event) {
+   std::map<Binding, int>::iterator it = bindings.find(Binding(event.to.sin_addr.s_addr, event.to.sin_port));
+   if (it == bindings.end())
+      return;
+
+   Socket &s = sockets[it->second - FIRST_FD];
+   if (s.queued_bytes + event.datagram.data.size() > (size_t) s.recv_buffer) {
+      ++overflowed;
+      return;
+   }
+   s.queued_bytes += event.datagram.data.size();
+   s.queue.push_back(std::move(event.datagram));
+   if (s.on_readable && !s.ready) {
+      s.ready = true;
+      ready.push_back(it->second);
+   }
+}
+
+/**
+ * Call back the watched sockets that hold datagrams until they are drained. A callback that does not consume a
+ * datagram is not called again until the next delivery.
+ */
+void MftpSimNet::dispatch_readable() {
+   while (!ready.empty()) {
+      std::vector<int> batch;
+      batch.swap(ready);
+      for (int fd : batch) {
+         sockets[fd - FIRST_FD].ready = false;
+         while (true) {
+            // Callbacks may open sockets (moving the socket table) or close this one: look it up every time
+            Socket *s = socket(fd);
+            if (!s || !s->on_readable || s->queue.empty())
+               break;
+            size_t queued = s->queue.size();
+            Callback callback = s->on_readable;
+            callback();
+            s = socket(fd);
+            if (s && s->queue.size() >= queued)
+               break;
+         }
+      }
+   }
+}
+
+/**
+ * Create a simulated host.
+ * @param net the network
+ * @param address the host's address
+ * @param link the host's link to the network core
+ */
+MftpSimNet::Host::Host(MftpSimNet &net, const in_addr &address, const MftpLinkModel &link)
+        : address(address), link(link), uplink_free_us(0), next_port(FIRST_EPHEMERAL_PORT), net(net) {
+}
+
+/**
+ * Open a socket on this host. The wildcard address binds the host's own address, and a zero or missing port binds an
+ * ephemeral port.
+ */
+int MftpSimNet::Host::open_socket(const sockaddr_in *local, bool shared) {
+   Socket s;
+   bzero(&s.local, sizeof(s.local));
+   s.local.sin_family = AF_INET;
+   s.local.sin_addr = address;
+   if (local && local->sin_addr.s_addr != htonl(INADDR_ANY) && local->sin_addr.s_addr != address.s_addr) {
+      errno = EADDRNOTAVAIL;
+      return -1;
+   }
+   if (local && local->sin_port != 0) {
+      s.local.sin_port = local->sin_port;
+      if (net.bindings.count(Binding(address.s_addr, local->sin_port)) && !shared) {
+         errno = EADDRINUSE;
+         return -1;
+      }
+   } else {
+      while (net.bindings.count(Binding(address.s_addr, htons(next_port))))
+         next_port = next_port == 65535 ? FIRST_EPHEMERAL_PORT : next_port + 1;
+      s.local.sin_port = htons(next_port);
+      next_port = next_port == 65535 ? FIRST_EPHEMERAL_PORT : next_port + 1;
+   }
+
+   s.host = this;
+   s.queued_bytes = 0;
+   s.recv_buffer = DEFAULT_RECV_BUFFER;
+   s.open = true;
+   s.ready = false;
+   net.sockets.push_back(std::move(s));
+
+   // A shared address delivers to the socket bound last
+   int fd = FIRST_FD + (int) net.sockets.size() - 1;
+   net.bindings[Binding(address.s_addr, net.sockets.back().local.sin_port)] = fd;
+   return fd;
+}
+
+int MftpSimNet::Host::close_socket(int sockfd) {
+   Socket *s = net.socket(sockfd);
+   if (!s)
+      return -1;
+
+   std::map<Binding, int>::iterator it = net.bindings.find(Binding(s->local.sin_addr.s_addr, s->local.sin_port));
+   if (it != net.bindings.end() && it->second == sockfd)
+      net.bindings.erase(it);
+   s->open = false;
+   s->on_readable = nullptr;
+   std::deque<Datagram>().swap(s->queue);
+   return 0;
+}
+
+/**
+ * Send a datagram: it leaves once the uplink has sent the datagrams queued before it, and arrives after the latency
+ * and jitter of both links, unless either link loses it.
+ */
+ssize_t MftpSimNet::Host::send_to(int sockfd, const char *data, size_t len, const sockaddr_in &to) {
+   Socket *s = net.socket(sockfd);
+   if (!s)
+      return -1;
+   ++net.sent;
+
+   uint64_t departure = std::max(net.clock_us, uplink_free_us);
+   if (link.bandwidth_mbps)
+      departure += ((len + UDP_IP_HEADERS) * 8 + link.bandwidth_mbps - 1) / link.bandwidth_mbps;
+   uplink_free_us = departure;
+
+   std::unordered_map<uint32_t, Host *>::iterator it = net.host_addresses.find(to.sin_addr.s_addr);
+   if (it == net.host_addresses.end() || net.chance(link.loss) || net.chance(it->second->link.loss)) {
+      ++net.lost;
+      return len;
+   }
+   const MftpLinkModel &remote = it->second->link;
+   uint64_t jitter = link.jitter_us + remote.jitter_us;
+   if (jitter)
+      jitter = std::uniform_int_distribution<uint64_t>(0, jitter)(net.random);
+
+   Event event;
+   event.timer = 0;
+   event.to = to;
+   event.datagram.from = s->local;
+   event.datagram.data.assign(data, data + len);
+   net.events.emplace(departure + link.latency_us + remote.latency_us + jitter, std::move(event));
+   return len;
+}
+
+/**
+ * Receive the oldest queued datagram. Simulated sockets never block: without a datagram, fail with EAGAIN.
+ */
+ssize_t MftpSimNet::Host::receive_from(int sockfd, char *data, size_t len, int flags, sockaddr_in *from) {
+   Socket *s = net.socket(sockfd);
+   if (!s)
+      return -1;
+   if (s->queue.empty()) {
+      errno = EAGAIN;
+      return -1;
+   }
+
+   Datagram &datagram = s->queue.front();
+   size_t n = std::min(len, datagram.data.size());
+   memcpy(data, datagram.data.data(), n);
+   if (from)
+      *from = datagram.from;
+   if (!(flags & MSG_PEEK)) {
+      s->queued_bytes -= datagram.data.size();
+      s->queue.pop_front();
+   }
+   return n;
+}
+
+/**
+ * Only the receive buffer size is simulated (doubled, like Linux); other options are accepted and have no effect.
+ */
+int MftpSimNet::Host::set_option(int sockfd, int level, int name, const void *value, socklen_t len) {
+   Socket *s = net.socket(sockfd);
+   if (!s)
+      return -1;
+   if (level == SOL_SOCKET && name == SO_RCVBUF && len >= sizeof(int))
+      s->recv_buffer = std::max(*(const int *) value, 0) * 2;
+   return 0;
+}
+
+int MftpSimNet::Host::get_option(int sockfd, int level, int name, void *value, socklen_t *len) {
+   Socket *s = net.socket(sockfd);
+   if (!s)
+      return -1;
+   if (level != SOL_SOCKET || name != SO_RCVBUF || *len < sizeof(int)) {
+      errno = ENOPROTOOPT;
+      return -1;
+   }
+   *(int *) value = s->recv_buffer;
+   *len = sizeof(int);
+   return 0;
+}
+
+/**
+ * The virtual clock, as a steady_clock time point (the simulation starts at the clock's epoch).
+ */
+MftpTransport::TimePoint MftpSimNet::Host::now() {
+   return TimePoint(std::chrono::microseconds(net.clock_us));
+}
@@ -0,0 +1,303 @@
+/**
+ * MftpStats.cpp holds the live transfer statistics for MultiFTP Clients and Servers: HDR-style latency histograms and
+ * counters per remote host, plus transfer-wide counters for throughput, retransmissions and window occupancy. All
+ * counters are updated with relaxed atomics from the transfer thread, and an optional exporter thread periodically
+ * writes a JSON snapshot to disk while the transfer runs.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "MftpStats.h"
+
+/**
+ * Create an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram() {
+   for (int i = 0; i < BUCKETS; ++i)
+      counts[i].store(0, std::memory_order_relaxed);
+   total.store(0, std::memory_order_relaxed);
+   sum.store(0, std::memory_order_relaxed);
+   min.store(UINT64_MAX, std::memory_order_relaxed);
+   max.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Map a value to its bucket. Values below 2 * SUB_BUCKETS map 1:1; larger values keep their SUB_BUCKET_BITS + 1 most
+ * significant bits.
+ * @param value the value in microseconds, clamped to MAX_VALUE_BITS
+ * @return the bucket index
+ */
+int LatencyHistogram::bucket_index(uint64_t value) {
+   if (value >= (1ULL << MAX_VALUE_BITS))
+      value = (1ULL << MAX_VALUE_BITS) - 1;
+   if (value < 2 * SUB_BUCKETS)
+      return (int) value;
+
+   int msb = 63 - __builtin_clzll(value);
+   int shift = msb - SUB_BUCKET_BITS;
+   return (shift + 1) * SUB_BUCKETS + (int) ((value >> shift) - SUB_BUCKETS);
+}
+
+/**
+ * The highest value that maps to a bucket (used when reporting percentiles).
+ * @param index the bucket index
+ * @return the largest value in microseconds recorded into this bucket
+ */
+uint64_t LatencyHistogram::bucket_value(int index) {
+   if (index < 2 * SUB_BUCKETS)
+      return index;
+
+   int shift = index / SUB_BUCKETS - 1;
+   uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+   return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * Record a latency sample. Safe to call concurrently with readers; uses relaxed atomics only.
+ * @param value_us the sample in microseconds
+ */
+void LatencyHistogram::record(uint64_t value_us) {
+   counts[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+   total.fetch_add(1, std::memory_order_relaxed);
+   sum.fetch_add(value_us, std::memory_order_relaxed);
+
+   // Single writer per histogram, so a plain compare-and-store is sufficient for the extrema
+   if (value_us < min.load(std::memory_order_relaxed))
+      min.store(value_us, std::memory_order_relaxed);
+   if (value_us > max.load(std::memory_order_relaxed))
+      max.store(value_us, std::memory_order_relaxed);
+}
+
+/**
+ * @return the number of samples recorded
+ */
+uint64_t LatencyHistogram::count() const {
+   return total.load(std::memory_order_relaxed);
+}
+
+/**
+ * Compute the value at or below which p percent of the samples fall.
+ * @param p percentile in the range 0 - 100
+ * @return the percentile value in microseconds, 0 if there are no samples
+ */
+uint64_t LatencyHistogram::percentile(double p) const {
+   uint64_t n = count();
+   if (n == 0)
+      return 0;
+
+   uint64_t target = (uint64_t) std::ceil((p / 100.0) * n);
+   if (target == 0)
+      target = 1;
+
+   uint64_t seen = 0;
+   for (int i = 0; i < BUCKETS; ++i) {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen >= target)
+         return std::min(bucket_value(i), max.load(std::memory_order_relaxed));
+   }
+   return max.load(std::memory_order_relaxed);
+}
+
+/**
+ * @return a JSON object summarizing this histogram
+ */
+std::string LatencyHistogram::to_json() const {
+   uint64_t n = count();
+   uint64_t lo = n ? min.load(std::memory_order_relaxed) : 0;
+   double mean = n ? (double) sum.load(std::memory_order_relaxed) / (double) n : 0.0;
+
+   return "{\"count\": " + std::to_string(n) +
+          ", \"min\": " + std::to_string(lo) +
+          ", \"mean\": " + std::to_string(mean) +
+          ", \"p50\": " + std::to_string(percentile(50)) +
+          ", \"p90\": " + std::to_string(percentile(90)) +
+          ", \"p99\": " + std::to_string(percentile(99)) +
+          ", \"p999\": " + std::to_string(percentile(99.9)) +
+          ", \"max\": " + std::to_string(max.load(std::memory_order_relaxed)) + "}";
+}
+
+/**
+ * Create the statistics for one remote host.
+ * @param name printable host name
+ */
+HostStats::HostStats(const std::string &name) : name(name), packets_sent(0), retransmissions(0), acks(0) {
+}
+
+/**
+ * Create the transfer-wide statistics.
+ * @param role "client" or "server", reported in the snapshot
+ */
+MftpStats::MftpStats(const std::string &role)
+        : packets_sent(0), packets_received(0), payload_bytes(0), retransmissions(0), timeouts(0), drops(0),
+          peer_repairs(0), receiver_stalls(0), window_occupancy(0), window_occupancy_max(0), role(role), exporting(false) {
+   start_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * Destructor -- stops the exporter thread (writing a final snapshot) if it is running.
+ */
+MftpStats::~MftpStats() {
+   stop_export();
+}
+
+/**
+ * Register a remote host. Must be called before start_export(); the exporter reads the host list without locking.
+ * @param name printable host name
+ * @return the new host statistics
+ */
+HostStats &MftpStats::add_host(const std::string &name) {
+   hosts.emplace_back(name);
+   return hosts.back();
+}
+
+/**
+ * Update the number of packet transmissions that are currently awaiting acknowledgement.
+ * @param occupancy number of un-acked (host, packet) pairs
+ */
+void MftpStats::set_window_occupancy(uint64_t occupancy) {
+   window_occupancy.store(occupancy, std::memory_order_relaxed);
+   if (occupancy > window_occupancy_max.load(std::memory_order_relaxed))
+      window_occupancy_max.store(occupancy, std::memory_order_relaxed);
+}
+
+/**
+ * @return the whole statistics set as a JSON document
+ */
+std::string MftpStats::to_json() const {
+   double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                         start_time).count() / 1000000.0;
+   uint64_t bytes = payload_bytes.load(std::memory_order_relaxed);
+
+   std::string json = "{\n  \"role\": " + json_string(role) + ",\n" +
+                      "  \"elapsed_s\": " + std::to_string(elapsed) + ",\n" +
+                      "  \"packets_sent\": " + std::to_string(packets_sent.load(std::memory_order_relaxed)) + ",\n" +
+                      "  \"packets_received\": " + std::to_string(packets_received.load(std::memory_order_relaxed)) +
+                      ",\n" +
+                      "  \"payload_bytes\": " + std::to_string(bytes) + ",\n" +
+                      "  \"throughput_Bps\": " + std::to_string(elapsed > 0 ? bytes / elapsed : 0.0) + ",\n" +
+                      "  \"retransmissions\": " + std::to_string(retransmissions.load(std::memory_order_relaxed)) +
+                      ",\n" +
+                      "  \"timeouts\": " + std::to_string(timeouts.load(std::memory_order_relaxed)) + ",\n" +
+                      "  \"drops\": " + std::to_string(drops.load(std::memory_order_relaxed)) + ",\n" +
+                      "  \"peer_repairs\": " + std::to_string(peer_repairs.load(std::memory_order_relaxed)) + ",\n" +
+                      "  \"receiver_stalls\": " + std::to_string(receiver_stalls.load(std::memory_order_relaxed)) +
+                      ",\n" +
+                      "  \"window_occupancy\": " + std::to_string(window_occupancy.load(std::memory_order_relaxed)) +
+                      ",\n" +
+                      "  \"window_occupancy_max\": " +
+                      std::to_string(window_occupancy_max.load(std::memory_order_relaxed)) + ",\n" +
+                      "  \"hosts\": [";
+
+   for (size_t i = 0; i < hosts.size(); ++i) {
+      const HostStats &h = hosts[i];
+      json += std::string(i ? "," : "") + "\n    {\"name\": " + json_string(h.name) +
+              ", \"packets_sent\": " + std::to_string(h.packets_sent.load(std::memory_order_relaxed)) +
+              ", \"retransmissions\": " + std::to_string(h.retransmissions.load(std::memory_order_relaxed)) +
+              ", \"acks\": " + std::to_string(h.acks.load(std::memory_order_relaxed)) +
+              ",\n     \"rtt_us\": " + h.rtt.to_json() +
+              ",\n     \"ack_latency_us\": " + h.ack_latency.to_json() + "}";
+   }
+
+   json += "\n  ]\n}\n";
+   return json;
+}
+
+/**
+ * Quote a string for JSON: escape the quotation mark, the backslash and the control characters (host names come from
+ * the commandline and may contain anything).
+ * @param text the string
+ * @return the JSON string literal, with its quotes
+ */
+std::string MftpStats::json_string(const std::string &text) {
+   std::string quoted = "\"";
+   for (char c : text) {
+      switch (c) {
+         case '"':
+            quoted += "\\\"";
+            break;
+         case '\\':
+            quoted += "\\\\";
+            break;
+         case '\n':
+            quoted += "\\n";
+            break;
+         case '\r':
+            quoted += "\\r";
+            break;
+         case '\t':
+            quoted += "\\t";
+            break;
+         default:
+            if ((unsigned char) c < 0x20) {
+               char escape[7];
+               snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char) c);
+               quoted += escape;
+            } else {
+               quoted += c;
+            }
+      }
+   }
+   return quoted + "\"";
+}
+
+/**
+ * Start a background thread that writes a JSON snapshot to path every interval_ms milliseconds.
+ * @param path output file; written to path + ".tmp" and renamed so readers never see a partial snapshot
+ * @param interval_ms snapshot period
+ */
+void MftpStats::start_export(const std::string &path, uint32_t interval_ms) {
+   if (exporting || path.empty())
+      return;
+   export_path = path;
+   exporting = true;
+   exporter = std::thread(&MftpStats::export_loop, this, interval_ms ? interval_ms : 1000);
+}
+
+/**
+ * Stop the exporter thread and write a final snapshot.
+ */
+void MftpStats::stop_export() {
+   {
+      std::lock_guard<std::mutex> lock(export_mutex);
+      if (!exporting)
+         return;
+      exporting = false;
+   }
+   export_cv.notify_all();
+   exporter.join();
+   write_snapshot();
+}
+
+/**
+ * Exporter thread body.
+ * @param interval_ms snapshot period
+ */
+void MftpStats::export_loop(uint32_t interval_ms) {
+   std::unique_lock<std::mutex> lock(export_mutex);
+   while (exporting) {
+      export_cv.wait_for(lock, std::chrono::milliseconds(interval_ms));
+      if (exporting)
+         write_snapshot();
+   }
+}
+
+/**
+ * Atomically replace the snapshot file with the current statistics.
+ */
+void MftpStats::write_snapshot() {
+   std::string tmp_path = export_path + ".tmp";
+   std::string json = to_json();
+
+   std::ofstream out(tmp_path, std::ios_base::trunc);
+   out.write(json.c_str(), json.length());
+   out.close();
+   std::rename(tmp_path.c_str(), export_path.c_str());
+}
@@ -0,0 +1,100 @@
+/**
+ * MftpStreamWriter.cpp implements the server's streaming sink: a bounded queue filled by the receiving server, drained
+ * to a file descriptor by a writer thread.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <sys/uio.h>
+
+#include "MftpStreamWriter.h"
+#include "UDP_Communicator.h"
+
+/**
+ * Start streaming to a file descriptor.
+ * @param fd the descriptor to write to (eg STDOUT_FILENO); it is not closed
+ */
+MftpStreamWriter::MftpStreamWriter(int fd) : fd(fd), queue(QUEUE_BYTES), write_failed(false) {
+   worker = std::thread(&MftpStreamWriter::run, this);
+}
+
+/**
+ * Destructor -- finish writing whatever was queued.
+ */
+MftpStreamWriter::~MftpStreamWriter() {
+   finish();
+}
+
+/**
+ * Queue a payload for writing.
+ * @param data the payload
+ * @param len the payload length
+ * @return false if the queue is full; the caller must not acknowledge the packet
+ */
+bool MftpStreamWriter::offer(const char *data, size_t len) {
+   return queue.offer(data, len);
+}
+
+/**
+ * Signal the end of the stream and wait until everything that was queued has been written.
+ */
+void MftpStreamWriter::finish() {
+   queue.close();
+   if (worker.joinable())
+      worker.join();
+}
+
+/**
+ * Writer thread: write the queued stream out. After a write error (eg the reader closed the pipe), the rest of the
+ * stream is discarded so that the transfer can still complete.
+ */
+void MftpStreamWriter::run() {
+   std::vector<std::string> chunks;
+   while (queue.take_all(chunks)) {
+      if (!failed() && !write_chunks(chunks)) {
+         UDP_Communicator::error("Unable to write the output stream: " + std::string(strerror(errno)));
+         write_failed.store(true, std::memory_order_relaxed);
+      }
+   }
+}
+
+/**
+ * Write a batch of chunks with as few system calls as possible, resuming after short writes.
+ * @param chunks the chunks, in order (consumed)
+ * @return false on a write error
+ */
+bool MftpStreamWriter::write_chunks(std::vector<std::string> &chunks) {
+   std::vector<struct iovec> iov;
+   for (std::string &chunk : chunks) {
+      if (!chunk.empty())
+         iov.push_back({&chunk[0], chunk.size()});
+   }
+
+   size_t first = 0;
+   while (first < iov.size()) {
+      ssize_t n = writev(fd, &iov[first], (int) std::min<size_t>(iov.size() - first, IOV_MAX));
+      if (n < 0) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+
+      // Skip the fully written chunks and advance into a partly written one
+      size_t written = (size_t) n;
+      while (first < iov.size() && written >= iov[first].iov_len)
+         written -= iov[first++].iov_len;
+      if (first < iov.size()) {
+         iov[first].iov_base = (char *) iov[first].iov_base + written;
+         iov[first].iov_len -= written;
+      }
+   }
+   return true;
+}
@@ -0,0 +1,210 @@
+/**
+ * MftpTimerWheel.cpp implements the hierarchical timer wheel: filing timers in their level and slot, cascading them
+ * down the levels as the clock advances, and collecting the expired ones.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "MftpTimerWheel.h"
+
+/**
+ * Create an empty wheel.
+ * @param now the current time in ticks
+ */
+MftpTimerWheel::MftpTimerWheel(uint64_t now) : current(now), armed(0), free_nodes(NIL) {
+   std::fill(heads, heads + LEVELS * SLOTS, NIL);
+   memset(occupied, 0, sizeof(occupied));
+}
+
+/**
+ * Arm a timer.
+ * @param expiry the tick at which it expires (a time that has passed expires on the next tick)
+ * @param payload a value returned by advance() when the timer expires (eg the index of a host)
+ * @return the timer, for cancel()
+ */
+MftpTimerWheel::TimerId MftpTimerWheel::arm(uint64_t expiry, uint64_t payload) {
+   uint32_t index = free_nodes;
+   if (index == NIL) {
+      index = (uint32_t) nodes.size();
+      nodes.emplace_back();
+      nodes.back().generation = 1;
+   } else {
+      free_nodes = nodes[index].next;
+   }
+
+   Node &node = nodes[index];
+   node.expiry = std::max(expiry, current + 1);
+   node.payload = payload;
+   node.armed = true;
+   file(index);
+   ++armed;
+   return (uint64_t) node.generation << 32 | index;
+}
+
+/**
+ * Cancel a timer that has not expired (cancelling an expired, cancelled or unknown timer does nothing).
+ * @param timer the timer returned by arm()
+ * @param payload if given, receives the payload of the cancelled timer
+ * @return true if the timer was armed
+ */
+bool MftpTimerWheel::cancel(TimerId timer, uint64_t *payload) {
+   uint32_t index = (uint32_t) timer;
+   if (index >= nodes.size() || !nodes[index].armed || nodes[index].generation != (uint32_t) (timer >> 32))
+      return false;
+
+   unlink(index);
+   if (payload)
+      *payload = nodes[index].payload;
+   release(index);
+   --armed;
+   return true;
+}
+
+/**
+ * Move the clock forward and collect the payloads of every timer that expired on the way, in expiry order (timers of
+ * the same tick in no particular order).
+ * @param now the current time in ticks (a time before the wheel's clock does nothing)
+ * @param expired the payloads are appended to it
+ * @return the number of expired timers
+ */
+size_t MftpTimerWheel::advance(uint64_t now, std::vector<uint64_t> &expired) {
+   size_t before = expired.size();
+   while (armed > 0) {
+      uint64_t tick = next_visit();
+      if (tick > now)
+         break;
+      current = tick;
+      visit(tick, expired);
+   }
+   current = std::max(current, now);
+   return expired.size() - before;
+}
+
+/**
+ * The next tick at which advance() has work to do: the expiry of a timer in the lowest level, or the cascade of an
+ * upper slot. It is never later than the earliest expiry, so it can be used to wake up the owner's loop.
+ * @return the tick, or NEVER if no timer is armed
+ */
+uint64_t MftpTimerWheel::next_visit() const {
+   uint64_t tick = NEVER;
+   for (unsigned level = 0; level < LEVELS && armed > 0; ++level) {
+      uint64_t base = (current >> (SLOT_BITS * level)) + 1;
+      unsigned start = (unsigned) (base & (SLOTS - 1));
+      int slot = next_occupied(occupied[level], start);
+      if (slot >= 0)
+         tick = std::min(tick, (base + (((unsigned) slot - start) & (SLOTS - 1))) << (SLOT_BITS * level));
+   }
+   return tick;
+}
+
+/**
+ * File a timer in the slot of its expiry, at the lowest level whose span covers its delay from the current tick.
+ * @param index the timer's node
+ */
+void MftpTimerWheel::file(uint32_t index) {
+   Node &node = nodes[index];
+   uint64_t delay = node.expiry - current;
+   unsigned level = 0;
+   while (level < LEVELS - 1 && delay >> (SLOT_BITS * (level + 1)))
+      ++level;
+
+   // Beyond the top level's span: wait in its farthest slot
+   uint64_t expiry = node.expiry;
+   if (delay >> (SLOT_BITS * LEVELS))
+      expiry = current + ((uint64_t) 1 << (SLOT_BITS * LEVELS)) - 1;
+
+   unsigned slot = (unsigned) ((expiry >> (SLOT_BITS * level)) & (SLOTS - 1));
+   node.slot = (uint16_t) (level * SLOTS + slot);
+   node.prev = NIL;
+   node.next = heads[node.slot];
+   if (node.next != NIL)
+      nodes[node.next].prev = index;
+   heads[node.slot] = index;
+   occupied[level][slot / 64] |= (uint64_t) 1 << (slot % 64);
+}
+
+/**
+ * Remove a timer from its slot.
+ * @param index the timer's node
+ */
+void MftpTimerWheel::unlink(uint32_t index) {
+   Node &node = nodes[index];
+   if (node.prev != NIL)
+      nodes[node.prev].next = node.next;
+   else
+      heads[node.slot] = node.next;
+   if (node.next != NIL)
+      nodes[node.next].prev = node.prev;
+
+   if (heads[node.slot] == NIL) {
+      unsigned slot = node.slot % SLOTS;
+      occupied[node.slot / SLOTS][slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+   }
+}
+
+/**
+ * Return a node to the free list; its id becomes stale.
+ * @param index the node
+ */
+void MftpTimerWheel::release(uint32_t index) {
+   Node &node = nodes[index];
+   node.armed = false;
+   if (++node.generation == 0)
+      node.generation = 1;
+   node.next = free_nodes;
+   free_nodes = index;
+}
+
+/**
+ * Process the slots the clock reaches at a tick, from the top level down: cascade the timers of upper slots, and
+ * collect the timers that are due.
+ * @param tick the tick (the current time)
+ * @param expired the payloads of the due timers are appended to it
+ */
+void MftpTimerWheel::visit(uint64_t tick, std::vector<uint64_t> &expired) {
+   for (unsigned level = LEVELS; level-- > 0;) {
+      if (tick & (((uint64_t) 1 << (SLOT_BITS * level)) - 1))
+         continue;
+
+      unsigned slot = (unsigned) ((tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+      uint32_t index = heads[level * SLOTS + slot];
+      heads[level * SLOTS + slot] = NIL;
+      occupied[level][slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+
+      while (index != NIL) {
+         uint32_t next = nodes[index].next;
+         if (nodes[index].expiry <= tick) {
+            expired.push_back(nodes[index].payload);
+            release(index);
+            --armed;
+         } else {
+            file(index);
+         }
+         index = next;
+      }
+   }
+}
+
+/**
+ * Find the first occupied slot of a level at or after a slot, wrapping around.
+ * @param bits the level's occupancy bitmap
+ * @param start the first slot to consider
+ * @return the slot, or -1 if the level is empty
+ */
+int MftpTimerWheel::next_occupied(const uint64_t *bits, unsigned start) {
+   unsigned word = start / 64;
+   uint64_t remaining = bits[word] & (~(uint64_t) 0 << (start % 64));
+   for (unsigned i = 0; i <= WORDS; ++i) {
+      if (remaining)
+         return (int) (word * 64 + __builtin_ctzll(remaining));
+      word = (word + 1) % WORDS;
+      remaining = bits[word];
+   }
+   return -1;
+}
@@ -0,0 +1,164 @@
+/**
+ * MftpTrace.cpp implements the binary packet trace: creating and mapping the ring file, and reading a trace back in
+ * the order it was written.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "MftpLogger.h"
+#include "MftpTrace.h"
+
+static_assert(sizeof(MftpTrace::Header) == 64, "The trace header is part of the file format");
+static_assert(sizeof(MftpTrace::Record) == 32, "The trace record is part of the file format");
+
+const char MftpTrace::MAGIC[8] = {'M', 'F', 'T', 'P', 'T', 'R', 'C', '1'};
+
+/**
+ * Create a closed trace.
+ */
+MftpTrace::MftpTrace() : fd(-1), header(nullptr), ring(nullptr), mask(0), mapped_bytes(0) {
+}
+
+/**
+ * Close the trace, if open.
+ */
+MftpTrace::~MftpTrace() {
+   close();
+}
+
+/**
+ * Create (or replace) the trace file and map it.
+ * @param path the trace file
+ * @param records the number of records in the ring (rounded up to a power of two)
+ * @param role whether the client or a server writes the trace
+ * @param port the port recorded in the header
+ * @param clock_offset_us CLOCK_REALTIME minus the protocol clock, in microseconds
+ * @return false if the file could not be created or mapped
+ */
+bool MftpTrace::open(const std::string &path, uint64_t records, Role role, int port, int64_t clock_offset_us) {
+   close();
+   uint64_t capacity = 1;
+   while (capacity < records)
+      capacity <<= 1;
+
+   fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return false;
+   size_t bytes = sizeof(Header) + capacity * sizeof(Record);
+   void *mapping = MAP_FAILED;
+   if (ftruncate(fd, bytes) == 0)
+      mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (mapping == MAP_FAILED) {
+      ::close(fd);
+      fd = -1;
+      return false;
+   }
+
+   mapped_bytes = bytes;
+   header = (Header *) mapping;
+   ring = (Record *) (header + 1);
+   mask = capacity - 1;
+   memcpy(header->magic, MAGIC, sizeof(MAGIC));
+   header->record_size = sizeof(Record);
+   header->role = role;
+   header->capacity = capacity;
+   header->written = 0;
+   header->clock_offset_us = clock_offset_us;
+   header->port = (uint32_t) port;
+   header->pid = (uint32_t) getpid();
+   header->boot_id = read_boot_id();
+   header->reserved = 0;
+   return true;
+}
+
+/**
+ * Read the first 64 bits of the kernel's boot ID, which identifies the current boot of this host.
+ * @return the identifier, or 0 if it is not available
+ */
+uint64_t MftpTrace::read_boot_id() {
+   std::ifstream in("/proc/sys/kernel/random/boot_id");
+   std::string text;
+   if (!std::getline(in, text))
+      return 0;
+   text.erase(std::remove(text.begin(), text.end(), '-'), text.end());
+   return strtoull(text.substr(0, 16).c_str(), nullptr, 16);
+}
+
+/**
+ * Unmap and close the trace file. A ring that never wrapped is truncated to the records written.
+ */
+void MftpTrace::close() {
+   if (!header)
+      return;
+   uint64_t written = header->written;
+   uint64_t capacity = header->capacity;
+   munmap(header, mapped_bytes);
+   // If the file cannot be truncated, the full-size ring is still a valid trace
+   if (written < capacity && ftruncate(fd, sizeof(Header) + written * sizeof(Record)) != 0)
+      MftpLogger::instance().log(MftpLogger::WARNING, "Could not truncate the trace file (errno {})", errno);
+   ::close(fd);
+   fd = -1;
+   header = nullptr;
+   ring = nullptr;
+}
+
+/**
+ * Read a trace file.
+ * @param path the trace file
+ * @param header receives the file header
+ * @param records receives the records still in the ring, oldest first
+ * @param problem receives the reason the file could not be read
+ * @return false if the file is not a readable trace
+ */
+bool MftpTrace::read(const std::string &path, Header &header, std::vector<Record> &records, std::string &problem) {
+   std::ifstream in(path, std::ios_base::binary);
+   if (!in) {
+      problem = strerror(errno);
+      return false;
+   }
+   if (!in.read((char *) &header, sizeof(header)) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+       header.record_size != sizeof(Record) || header.capacity == 0 ||
+       (header.capacity & (header.capacity - 1)) != 0) {
+      problem = "not a MultiFTP trace";
+      return false;
+   }
+
+   // The records of a full ring start at the oldest; a truncated file (or one cut short) holds what was written
+   uint64_t count = std::min(header.written, header.capacity);
+   std::vector<Record> ring(count);
+   in.read((char *) ring.data(), count * sizeof(Record));
+   count = in.gcount() / sizeof(Record);
+   ring.resize(count);
+
+   uint64_t oldest = header.written > header.capacity ? header.written & (header.capacity - 1) : 0;
+   records.clear();
+   records.reserve(count);
+   for (uint64_t i = 0; i < count; ++i)
+      records.push_back(ring[(oldest + i) % count]);
+   return true;
+}
+
+/**
+ * The name of an event, for reports.
+ * @param event the Event
+ * @return its name ("unknown" for an invalid value)
+ */
+const char *MftpTrace::event_name(uint8_t event) {
+   static const char *names[EVENT_COUNT] = {
+      "unknown", "send", "retransmit", "timeout", "ack_received", "stall", "receive", "duplicate", "drop", "ack_sent"
+   };
+   return event < EVENT_COUNT ? names[event] : names[0];
+}
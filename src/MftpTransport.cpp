@@ -0,0 +1,123 @@
+/**
+ * MftpTransport.cpp implements the real-network transport: thin wrappers around the socket system calls.
+ *
+ * Created on: October 18th, 2026
+ * Author: Stevan Dupor
+ * Copyright (C) 2021 Stevan Dupor - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited.
+ */
+
+#include <unistd.h>
+
+#include "MftpTransport.h"
+
+/**
+ * The process-wide real-network transport.
+ */
+MftpSocketTransport &MftpSocketTransport::instance() {
+   static MftpSocketTransport transport;
+   return transport;
+}
+
+/**
+ * Open a UDP socket with socket(), and bind() it if a local address is given.
+ * @param local the address to bind (nullptr: unbound, the kernel picks the port on the first send)
+ * @param shared set SO_REUSEADDR before binding
+ * @return the socket descriptor, or -1 on failure (errno is set)
+ */
+int MftpSocketTransport::open_socket(const sockaddr_in *local, bool shared) {
+   int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+   if (sockfd < 0)
+      return -1;
+
+   if (shared) {
+      int reuse = 1;
+      setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+   }
+   if (local && bind(sockfd, (const struct sockaddr *) local, sizeof(*local)) < 0) {
+      close(sockfd);
+      return -1;
+   }
+   return sockfd;
+}
+
+/**
+ * Close a socket.
+ * @param sockfd the socket
+ * @return 0, or -1 on failure (errno is set)
+ */
+int MftpSocketTransport::close_socket(int sockfd) {
+   return close(sockfd);
+}
+
+/**
+ * Send a datagram with sendto().
+ * @param sockfd the socket
+ * @param data the datagram
+ * @param len the datagram length
+ * @param to the destination
+ * @return the bytes sent, or -1 on failure (errno is set, eg EMSGSIZE above the path MTU with IP_PMTUDISC_DO)
+ */
+ssize_t MftpSocketTransport::send_to(int sockfd, const char *data, size_t len, const sockaddr_in &to) {
+   return sendto(sockfd, data, len, 0, (const struct sockaddr *) &to, sizeof(to));
+}
+
+/**
+ * Receive a datagram with recvfrom(). Without MSG_DONTWAIT, the call waits up to the socket's SO_RCVTIMEO.
+ * @param sockfd the socket
+ * @param data the buffer
+ * @param len the buffer length (a longer datagram is truncated)
+ * @param flags recvfrom() flags
+ * @param from receives the source address
+ * @return the datagram length, or -1 if none arrived (errno is set, EAGAIN on a timeout)
+ */
+ssize_t MftpSocketTransport::receive_from(int sockfd, char *data, size_t len, int flags, sockaddr_in *from) {
+   socklen_t length = sizeof(*from);
+   return recvfrom(sockfd, data, len, flags, (struct sockaddr *) from, &length);
+}
+
+/**
+ * Set a socket option with setsockopt().
+ * @param sockfd the socket
+ * @param level the protocol level (SOL_SOCKET, IPPROTO_IP, ...)
+ * @param name the option
+ * @param value the option value
+ * @param len the value length
+ * @return 0, or -1 on failure (errno is set)
+ */
+int MftpSocketTransport::set_option(int sockfd, int level, int name, const void *value, socklen_t len) {
+   return setsockopt(sockfd, level, name, value, len);
+}
+
+/**
+ * Read a socket option with getsockopt().
+ * @param sockfd the socket
+ * @param level the protocol level
+ * @param name the option
+ * @param value receives the option value
+ * @param len the size of the value buffer; receives the value length
+ * @return 0, or -1 on failure (errno is set)
+ */
+int MftpSocketTransport::get_option(int sockfd, int level, int name, void *value, socklen_t *len) {
+   return getsockopt(sockfd, level, name, value, len);
+}
+
+/**
+ * Ask the kernel for its current path MTU estimate towards an address, using a temporary connected socket.
+ * @param to the remote host
+ * @return the path MTU in bytes, or 0 if unknown
+ */
+int MftpSocketTransport::path_mtu(const sockaddr_in &to) {
+   int mtu = 0;
+   int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+   if (sockfd < 0)
+      return 0;
+
+   if (connect(sockfd, (const struct sockaddr *) &to, sizeof(to)) == 0) {
+      socklen_t len = sizeof(mtu);
+      if (getsockopt(sockfd, IPPROTO_IP, IP_MTU, &mtu, &len) < 0)
+         mtu = 0;
+   }
+   close(sockfd);
+   return mtu;
+}
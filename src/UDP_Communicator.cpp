@@ -9,13 +9,54 @@
  * Unauthorized copying of this file, via any medium is strictly prohibited.
  */
 
+#include <arpa/inet.h>
+
 #include "UDP_Communicator.h"
 
 /**
  * Destructor -- override in subclasses.
  */
 UDP_Communicator::~UDP_Communicator() {
-   //Empty Destructor -- Override in Subclasses
+   delete profiler;
+   delete tracer;
+}
+
+/**
+ * Enable profiling mode: open the performance counters for the calling (transfer) thread and start timing the
+ * transfer phases. The profile is reported along with the system report.
+ */
+void UDP_Communicator::enable_profiling() {
+   if (profiler)
+      return;
+   profiler = new MftpProfiler();
+   profiler->start();
+}
+
+/**
+ * Enable the packet trace: create the ring file that every packet event is recorded into (see MftpTrace).
+ * @param path the trace file
+ * @param records the capacity of the ring, in records
+ * @param role whether this is the client or a server
+ * @param port the port recorded in the trace header (that of the server)
+ * @return false if the file could not be created
+ */
+bool UDP_Communicator::open_trace(const std::string &path, uint64_t records, MftpTrace::Role role, int port) {
+   if (tracer)
+      return true;
+
+   // Traces are aligned on the wall clock, which the protocol clock (monotonic or simulated) is offset from
+   int64_t offset_us = std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::system_clock::now().time_since_epoch()).count() -
+                       std::chrono::duration_cast<std::chrono::microseconds>(
+           transport->now().time_since_epoch()).count();
+   tracer = new MftpTrace();
+   if (!tracer->open(path, records, role, port, offset_us)) {
+      error("Could not create the trace file " + path + ": " + strerror(errno));
+      delete tracer;
+      tracer = nullptr;
+      return false;
+   }
+   return true;
 }
 
 /**
@@ -24,24 +65,18 @@ UDP_Communicator::~UDP_Communicator() {
  * @param port Port to bind socket to
  * @return a socket file descriptor for the bound socket
  */
-int UDP_Communicator::create_bound_UDP_socket(int port) {
+int UDP_Communicator::create_bound_UDP_socket(int port, bool shared) {
    int sockfd; // socket descriptor
    struct sockaddr_in serv_addr; //socket addresses
 
-   // Create the socket
-   sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-   if (sockfd < 0) {
-      error("ERROR opening socket");
-      return -1;
-   }
-
    // Initialize address and port values
    bzero((char *) &serv_addr, sizeof(serv_addr));
    serv_addr.sin_family = AF_INET;
    serv_addr.sin_port = htons(port);
 
-   // Bind the socket
-   if (bind(sockfd, (const struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+   // Create and bind the socket (several servers on one host may share a multicast port)
+   sockfd = transport->open_socket(&serv_addr, shared);
+   if (sockfd < 0) {
       error("Error on socket bind");
       return -1;
    }
@@ -67,18 +102,63 @@ int UDP_Communicator::create_unbound_UDP_socket(int port) {
    socket_timeout.tv_usec = 10;
 
    // Create the socket
-   sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-   setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof socket_timeout);
+   sockfd = transport->open_socket(nullptr, false);
    if (sockfd < 0) {
       error("ERROR opening socket");
       return -1;
    }
+   transport->set_option(sockfd, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof socket_timeout);
 
    // Report that the socket was established and return the sockfd
    verbose("Outgoing Socket established on port: " + std::to_string(port));
    return sockfd;
 }
 
+/**
+ * Establish an outgoing UDP socket (polled like create_unbound_UDP_socket()) whose packets leave from a given local
+ * address, on an ephemeral port. Replies come back to the same address, so each local interface is a separate path.
+ *
+ * @param local the local address to send from
+ * @return a socket file descriptor, or -1 if the address cannot be bound
+ */
+int UDP_Communicator::create_local_UDP_socket(const in_addr &local) {
+   struct sockaddr_in local_addr;
+   bzero((char *) &local_addr, sizeof(local_addr));
+   local_addr.sin_family = AF_INET;
+   local_addr.sin_addr = local;
+   local_addr.sin_port = 0;
+
+   int sockfd = transport->open_socket(&local_addr, false);
+   if (sockfd < 0) {
+      error("Unable to bind to local address " + std::string(inet_ntoa(local)));
+      return -1;
+   }
+
+   struct timeval socket_timeout;
+   socket_timeout.tv_sec = 0;
+   socket_timeout.tv_usec = 10;
+   transport->set_option(sockfd, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof socket_timeout);
+   return sockfd;
+}
+
+/**
+ * Resize a socket buffer and read back the size the kernel actually applied (Linux doubles the request for bookkeeping
+ * and caps it at net.core.rmem_max / wmem_max).
+ *
+ * @param sockfd socket to configure
+ * @param optname SO_SNDBUF or SO_RCVBUF
+ * @param bytes requested size
+ * @return the resulting buffer size in bytes
+ */
+int UDP_Communicator::set_socket_buffer(int sockfd, int optname, int bytes) {
+   transport->set_option(sockfd, SOL_SOCKET, optname, &bytes, sizeof(bytes));
+
+   int actual = 0;
+   socklen_t len = sizeof(actual);
+   transport->get_option(sockfd, SOL_SOCKET, optname, &actual, &len);
+   return actual;
+}
+
 /**
  * Read the sequence number of the packet currently in the input buffer and convert from 4 characters to a 32-bit
  * unsigned int
@@ -113,11 +193,15 @@ uint16_t UDP_Communicator::decode_checksum() {
 }
 
 /**
- * Read the packet type of the packet in the input buffer and return the user-friendly enum value of this packet.
+ * Read the packet type of the packet in the input buffer (legacy or v2 header) and return the user-friendly enum
+ * value of this packet.
  * @return enum user-friendly type of this input packet
  */
 uint16_t UDP_Communicator::decode_packet_type() {
-   if (in_buffer[6] == '\x55' && in_buffer[7] == '\x55')
+   WireHeaderV2View header(in_buffer);
+   if (header.is_v2())
+      return header.type();
+   else if (in_buffer[6] == '\x55' && in_buffer[7] == '\x55')
       return DATA_PACKET;
    else if (in_buffer[6] == '\xAA' && in_buffer[7] == '\xAA')
       return ACK;
@@ -195,13 +279,73 @@ void UDP_Communicator::encode_packet_type(int type) {
    }
 }
 
+/**
+ * Write a complete v2 header (including the checksum) for the packet in the output buffer. The payload must already be
+ * in place after the header.
+ * @param type user-friendly packet type
+ * @param flags v2 header flags
+ * @param offset byte offset of the payload in the transferred stream (for ACKs: the next expected byte)
+ * @param payload_len number of payload bytes following the header
+ */
+void UDP_Communicator::encode_v2_header(int type, uint16_t flags, uint64_t offset, uint16_t payload_len) {
+   WireHeaderV2View header(out_buffer);
+   header.set_version();
+   header.set_type(type);
+   header.set_flags(flags);
+   header.set_session_id(session_id);
+   header.set_payload_len(payload_len);
+   header.set_offset(offset);
+   header.set_checksum(v2_checksum(out_buffer));
+}
+
+/**
+ * Confirm that the v2 packet in the input buffer is complete and that its checksum matches.
+ * @param received_len number of bytes returned by recvfrom()
+ * @return true if the packet is intact
+ */
+bool UDP_Communicator::valid_v2_checksum(int received_len) {
+   WireHeaderV2View header(in_buffer);
+   if (received_len < 0 || WireHeaderV2View::SIZE + header.payload_len() > (size_t) received_len)
+      return false;
+   return header.checksum() == v2_checksum(in_buffer);
+}
+
+/**
+ * Compute the 16-bit 1's complement checksum of a v2 packet: the header (excluding the checksum field) and exactly
+ * payload_len bytes of payload, summed as 16-bit words. Unlike the legacy checksum, bytes past the payload are not
+ * covered, so buffers need not be zero-filled.
+ * @param buffer a buffer holding a v2 packet
+ * @return 16-bit checksum
+ */
+uint16_t UDP_Communicator::v2_checksum(char *buffer) {
+   WireHeaderV2View header(buffer);
+   const unsigned char *bytes = (const unsigned char *) buffer;
+   size_t len = WireHeaderV2View::SIZE + header.payload_len();
+   uint64_t sum = 0;
+
+   // Sum 16-bit words, skipping the checksum field at bytes 4-5
+   sum += (bytes[0] << 8) | bytes[1];
+   sum += (bytes[2] << 8) | bytes[3];
+   size_t i = 6;
+   for (; i + 1 < len; i += 2)
+      sum += (bytes[i] << 8) | bytes[i + 1];
+   if (i < len)
+      sum += bytes[i] << 8;
+
+   // Fold the carries back in until the sum fits in 16 bits, then invert
+   while (sum >> 16)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+   return ~sum & 0xFFFF;
+}
+
 /** (Sent data)
  * Print data (that has been sent by this host) in dark yellow.
  * @param input the string to print
  */
 void UDP_Communicator::print_sent(std::string input) {
-   std::cout << "\033[33m" << input << "\033[0m";
-   std::cout.flush();
+   MftpLogger::instance().flush();
+   MftpLogger::instance().console() << "\033[33m" << input << "\033[0m";
+   MftpLogger::instance().console().flush();
 }
 
 /**(received data)
@@ -209,8 +353,9 @@ void UDP_Communicator::print_sent(std::string input) {
  * @param input the string to print
  */
 void UDP_Communicator::print_recv(std::string input) {
-   std::cout << "\033[32m" << input << "\033[0m";
-   std::cout.flush();
+   MftpLogger::instance().flush();
+   MftpLogger::instance().console() << "\033[32m" << input << "\033[0m";
+   MftpLogger::instance().console().flush();
 
 }
 
@@ -220,7 +365,8 @@ void UDP_Communicator::print_recv(std::string input) {
  */
 void UDP_Communicator::verbose(std::string input) {
    if (debug) {
-      std::cout << "\033[35m" << input << "\033[0m" << std::endl;
+      MftpLogger::instance().flush();
+      MftpLogger::instance().console() << "\033[35m" << input << "\033[0m" << std::endl;
    }
 }
 
@@ -229,7 +375,8 @@ void UDP_Communicator::verbose(std::string input) {
  * @param input the string to print
  */
 void UDP_Communicator::error(std::string input) {
-   std::cout << "\033[91m" << input << "\033[0m" << std::endl;
+   MftpLogger::instance().flush();
+   MftpLogger::instance().console() << "\033[91m" << input << "\033[0m" << std::endl;
 }
 
 /** (system warnings)
@@ -237,7 +384,8 @@ void UDP_Communicator::error(std::string input) {
  * @param input the string to print
  */
 void UDP_Communicator::warning(std::string input) {
-   std::cout << "\033[93m" << input << "\033[0m" << std::endl;
+   MftpLogger::instance().flush();
+   MftpLogger::instance().console() << "\033[93m" << input << "\033[0m" << std::endl;
 }
 
 /** (information messages)
@@ -245,5 +393,6 @@ void UDP_Communicator::warning(std::string input) {
  * @param input the string to print
  */
 void UDP_Communicator::info(std::string input) {
-   std::cout << "\033[36m" << input << "\033[0m" << std::endl;
+   MftpLogger::instance().flush();
+   MftpLogger::instance().console() << "\033[36m" << input << "\033[0m" << std::endl;
 }